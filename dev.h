@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Character Devices */
+
+#ifndef __DEV_H__
+#define __DEV_H__
+
+#include <linux/pci.h>
+#include <linux/fs.h>
+#include <linux/compat.h>
+#include <linux/version.h>
+#include <linux/miscdevice.h>
+
+/* Maximum length of a device node name, including the node suffix. */
+#define RYZEN_DEV_NAME_MAX                 32
+
+/**
+ * A device node bound to the SMU of a single root complex.
+ */
+struct ryzen_dev_node {
+    struct miscdevice              misc;
+    struct pci_dev*                dev;
+    u32                            node;
+    char                           name[RYZEN_DEV_NAME_MAX];
+};
+
+/**
+ * Fills in the name of the device node of [node]. The first node keeps the unsuffixed name so that
+ *  single socket systems and existing users are unaffected, the others are suffixed by their number.
+ */
+static inline void ryzen_dev_node_name(struct ryzen_dev_node* dnode, const char* base) {
+    if (dnode->node)
+        snprintf(dnode->name, sizeof(dnode->name), "%s%u", base, dnode->node);
+    else
+        snprintf(dnode->name, sizeof(dnode->name), "%s", base);
+}
+
+/**
+ * Handles ioctls of 32-bit processes, whose arguments are all pointers to structures laid out the
+ *  same way as for 64-bit ones and only need converting.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0) || !defined(CONFIG_COMPAT)
+#define ryzen_dev_compat_ioctl             compat_ptr_ioctl
+#else
+static inline long ryzen_dev_compat_ioctl(struct file* filp, unsigned int cmd, unsigned long arg) {
+    return filp->f_op->unlocked_ioctl(filp, cmd, (unsigned long)compat_ptr(arg));
+}
+#endif
+
+/**
+ * Creates or removes /dev/ryzen_smu, used to queue SMU commands for the SMU of [dev], bound as
+ *  [node].
+ *
+ * Returns 0 on success, anything else on failure.
+ */
+int smu_dev_register(struct pci_dev* dev, u32 node);
+void smu_dev_unregister(u32 node);
+
+/**
+ * Creates or removes /dev/ryzen_smn, used to access the SMN address space of [dev], bound as
+ *  [node].
+ *
+ * Returns 0 on success, anything else on failure.
+ */
+int smn_dev_register(struct pci_dev* dev, u32 node);
+void smn_dev_unregister(u32 node);
+
+/* Bounds of the interval, in microseconds, at which the PM table is sampled when enabled. */
+#define PM_SAMPLE_INTERVAL_MIN_US          1000
+#define PM_SAMPLE_INTERVAL_MAX_US          10000000
+
+/* Maximum number of entries of the PM table history, several minutes of samples at 1 kHz. */
+#define PM_HISTORY_MAX_LEN                 262144
+
+/* Parameters for the PM table sampler. */
+extern uint pm_sample_interval_us;
+extern uint pm_history_len;
+
+/**
+ * Wakes the PM table samplers of every node so that they pick up a new pm_sample_interval_us,
+ *  resuming sampling if they were paused.
+ */
+void smu_pm_dev_sampler_wake(void);
+
+/**
+ * Creates or removes /dev/ryzen_smu_pm, exposing a snapshot of the PM table of [dev], bound as
+ *  [node], which reports the table as [version].
+ *
+ * Returns 0 on success, anything else on failure.
+ */
+int smu_pm_dev_register(struct pci_dev* dev, u32 node, u32 version);
+void smu_pm_dev_unregister(u32 node);
+
+/**
+ * Reads the 32 bit word at [offset] of the PM table snapshot of [node], refreshing it first when it
+ *  is older than [max_age_us], or pm_refresh_interval_us for RYZEN_SMU_PM_MAX_AGE_DEFAULT.
+ *
+ * Returns 0 on success, -ENODEV if there is no snapshot and -EINVAL if the offset is out of range.
+ */
+int smu_pm_dev_read_word(u32 node, u32 offset, u32 max_age_us, u32* value);
+
+/**
+ * Reads the 32 bit word at [offset] of the PM table snapshot of [node] without blocking, for use in
+ *  atomic context. A refresh is scheduled when the snapshot is older than pm_refresh_interval_us.
+ * Must not be called once the snapshot device of the node is being unregistered.
+ *
+ * Returns 0 on success, -EAGAIN while the snapshot is being refreshed, -ENODEV if there is no
+ *  snapshot and -EINVAL if the offset is out of range.
+ */
+int smu_pm_dev_peek_word(u32 node, u32 offset, u32* value);
+
+/**
+ * Creates or removes /dev/ryzen_smu_pm_table, giving offset based access to the PM table of [dev],
+ *  bound as [node].
+ *
+ * Returns 0 on success, anything else on failure.
+ */
+int smu_pm_table_dev_register(struct pci_dev* dev, u32 node);
+void smu_pm_table_dev_unregister(u32 node);
+
+/**
+ * Notifies pollers of the pm_table sysfs attributes of [node] that the snapshot of
+ *  /dev/ryzen_smu_pm was refreshed. Implemented by the driver core.
+ */
+void ryzen_smu_pm_table_notify(u32 node);
+
+#endif /* __DEV_H__ */
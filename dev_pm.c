@@ -0,0 +1,811 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Snapshot Device */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/miscdevice.h>
+
+#include "smu.h"
+#include "dev.h"
+#include "pm_delta.h"
+
+/**
+ * Snapshot of the PM table shared with userspace through mmap(), laid out as described by
+ *  struct ryzen_smu_pm_header.
+ * Open files hold a reference so the buffer outlives the device for as long as it is mapped.
+ */
+struct smu_pm_snapshot {
+    struct kref                    ref;
+
+    // Serializes updates of the snapshot and protects dev.
+    struct mutex                   lock;
+
+    // Cleared once the device is removed, after which the snapshot is no longer updated.
+    struct pci_dev*                dev;
+    u32                            node;
+
+    // Woken upon every update of the snapshot.
+    wait_queue_head_t              wait;
+
+    struct ryzen_smu_pm_header*    hdr;
+    u8*                            table;
+
+    // Delta compressed history of every refresh, protected by the lock. History is set up only when
+    //  history_mem was allocated.
+    struct pm_delta_history        history;
+    void*                          history_mem;
+
+    // Periodically refreshes the snapshot, see pm_sample_interval_us.
+    struct task_struct*            sampler;
+
+    // Refreshes the snapshot on behalf of readers in atomic context, see smu_pm_dev_peek_word().
+    struct work_struct             refresh_work;
+
+    // Refreshes the snapshot once it becomes older than a poller accepts, see smu_pm_dev_poll().
+    //  Holds a reference to the snapshot while pending.
+    struct delayed_work            poll_work;
+
+    // Receives the table from the SMU, protected by the lock, so that the snapshot is only being
+    //  updated for the time it takes to copy it rather than for the whole transfer.
+    u8                             bounce[PM_TABLE_MAX_SIZE];
+};
+
+struct smu_pm_file {
+    struct smu_pm_snapshot*        snap;
+
+    // Sequence counter of the snapshot when it was last read through this file.
+    u32                            seen;
+
+    // Age of the table accepted by refreshes through this file, see RYZEN_SMU_PM_IOC_SET_MAX_AGE.
+    u32                            max_age_us;
+};
+
+struct smu_pm_node {
+    struct ryzen_dev_node          dnode;
+    struct smu_pm_snapshot*        snap;
+};
+
+static struct smu_pm_node smu_pm_nodes[SMU_MAX_NODES];
+
+// Amount of history samples decoded by a drain for every time it takes the lock of the snapshot.
+#define PM_DRAIN_CHUNK                     16
+
+// Serializes waking the samplers against starting and stopping them.
+static DEFINE_MUTEX(smu_pm_sampler_lock);
+
+static void smu_pm_snapshot_release(struct kref* ref) {
+    struct smu_pm_snapshot* snap = container_of(ref, struct smu_pm_snapshot, ref);
+
+    vfree(snap->history_mem);
+    vfree(snap->hdr);
+    kfree(snap);
+}
+
+static void smu_pm_snapshot_put(struct smu_pm_snapshot* snap) {
+    kref_put(&snap->ref, smu_pm_snapshot_release);
+}
+
+// Callers must hold the lock of the snapshot.
+static void smu_pm_snapshot_record(struct smu_pm_snapshot* snap) {
+    if (snap->history_mem && snap->hdr->size == snap->history.words * sizeof(u32))
+        pm_delta_append(&snap->history, snap->table, snap->hdr->timestamp_ns);
+}
+
+static void smu_pm_snapshot_history_init(struct smu_pm_snapshot* snap, u32 node) {
+    size_t size;
+
+    size = pm_delta_mem_size(snap->hdr->size, min_t(u32, pm_history_len, PM_HISTORY_MAX_LEN));
+
+    snap->history_mem = size ? vmalloc(size) : NULL;
+
+    if (!snap->history_mem || pm_delta_init(&snap->history, snap->history_mem, size, snap->hdr->size)) {
+        pr_warn("Unable to allocate the PM table history of node %d", node);
+
+        vfree(snap->history_mem);
+        snap->history_mem = NULL;
+        return;
+    }
+
+    // Holds the initial refresh, which happened before the history existed.
+    smu_pm_snapshot_record(snap);
+}
+
+/**
+ * Refreshes the PM table and copies it into the snapshot, recording it in the history.
+ * Nothing is done if the snapshot is at most [max_age_us] old, and the snapshot is left untouched
+ *  if the refresh fails.
+ * Readers retry while the sequence counter is odd or changed during their read.
+ */
+static int smu_pm_snapshot_refresh(struct smu_pm_snapshot* snap, u32 max_age_us) {
+    enum smu_return_val ret = SMU_Return_Unsupported;
+    size_t len = PM_TABLE_MAX_SIZE;
+    ktime_t refreshed;
+
+    mutex_lock(&snap->lock);
+
+    if (snap->dev && snap->hdr->size &&
+        ktime_get_ns() - snap->hdr->timestamp_ns <= (u64)max_age_us * NSEC_PER_USEC) {
+        mutex_unlock(&snap->lock);
+        return 0;
+    }
+
+    if (snap->dev)
+        ret = smu_read_pm_table_aged(snap->dev, snap->bounce, &len, max_age_us, &refreshed);
+
+    if (ret == SMU_Return_OK) {
+        WRITE_ONCE(snap->hdr->seq, snap->hdr->seq + 1);
+        smp_wmb();
+
+        memcpy(snap->table, snap->bounce, len);
+        snap->hdr->size = len;
+
+        // The table may have been transferred by the SMU for an earlier reader, its age counts
+        //  from then rather than from this copy.
+        snap->hdr->timestamp_ns = ktime_to_ns(refreshed);
+
+        smp_wmb();
+        WRITE_ONCE(snap->hdr->seq, snap->hdr->seq + 1);
+
+        smu_pm_snapshot_record(snap);
+
+        // Under the lock as the sysfs attributes are removed only after the device.
+        wake_up_interruptible(&snap->wait);
+        ryzen_smu_pm_table_notify(snap->node);
+    }
+
+    mutex_unlock(&snap->lock);
+
+    switch (ret) {
+        case SMU_Return_OK:
+            return 0;
+        case SMU_Return_Unsupported:
+            return -ENODEV;
+        default:
+            return -EIO;
+    }
+}
+
+// Age of the table accepted by readers which didn't ask for another, see pm_refresh_interval_us.
+static u32 smu_pm_default_max_age(void) {
+    return min_t(u32, READ_ONCE(pm_refresh_interval_us), PM_REFRESH_INTERVAL_MAX_US);
+}
+
+/**
+ * Refreshes the snapshot every pm_sample_interval_us, against absolute deadlines so that samples
+ *  remain evenly spaced regardless of how long each refresh takes.
+ */
+static int smu_pm_sampler(void* arg) {
+    struct smu_pm_snapshot* snap = arg;
+    ktime_t next, now;
+    u32 interval;
+
+    next = ktime_get();
+
+    while (!kthread_should_stop()) {
+        interval = READ_ONCE(pm_sample_interval_us);
+
+        // Sampling is paused until the interval is set, see smu_pm_dev_sampler_wake().
+        if (!interval) {
+            set_current_state(TASK_INTERRUPTIBLE);
+
+            if (!READ_ONCE(pm_sample_interval_us) && !kthread_should_stop())
+                schedule();
+
+            __set_current_state(TASK_RUNNING);
+
+            next = ktime_get();
+            continue;
+        }
+
+        interval = clamp_val(interval, PM_SAMPLE_INTERVAL_MIN_US, PM_SAMPLE_INTERVAL_MAX_US);
+        next = ktime_add_us(next, interval);
+
+        // Skip the samples that were missed rather than catching up in a burst.
+        now = ktime_get();
+        if (ktime_before(next, now))
+            next = now;
+
+        set_current_state(TASK_INTERRUPTIBLE);
+        schedule_hrtimeout_range(&next, div_u64((u64)interval * NSEC_PER_USEC, 100), HRTIMER_MODE_ABS);
+
+        if (kthread_should_stop())
+            break;
+
+        // Every tick wants a new table, so a zero age has the SMU transfer it regardless of
+        //  pm_refresh_interval_us. The interval is already bounded by the sampler.
+        smu_pm_snapshot_refresh(snap, 0);
+    }
+
+    return 0;
+}
+
+/**
+ * Stores the table last decoded by [cur], with sequence number [seq], at [dst]. Delta drains store
+ *  the words which changed since the previous table unless [full], others the whole table padded
+ *  to the stride.
+ *
+ * Returns the size of the entry.
+ */
+static u32 smu_pm_drain_entry(u8* dst, const struct pm_delta_cursor* cur, u64 seq, u32 size, bool delta,
+    bool full) {
+    struct ryzen_smu_pm_sample sample = { 0 };
+    struct ryzen_smu_pm_delta hdr = { 0 };
+    struct ryzen_smu_pm_delta_word* words;
+    u32 i, bits, n = 0;
+
+    if (!delta) {
+        sample.seq = seq;
+        sample.timestamp_ns = cur->timestamp;
+        sample.size = size;
+
+        memcpy(dst, &sample, sizeof(sample));
+        memcpy(dst + sizeof(sample), cur->table, size);
+
+        return ALIGN(sizeof(sample) + size, 8);
+    }
+
+    hdr.seq = seq;
+    hdr.timestamp_ns = cur->timestamp;
+
+    // Keyframes are stored whole, as are deltas changing so much of the table that it is smaller.
+    if (full || !cur->bitmap || cur->changed * sizeof(*words) >= ALIGN(size, 8)) {
+        hdr.size = ALIGN(size, 8);
+        hdr.flags = RYZEN_SMU_PM_DELTA_FULL;
+
+        memcpy(dst + sizeof(hdr), cur->table, size);
+        memset(dst + sizeof(hdr) + size, 0, hdr.size - size);
+    } else {
+        words = (struct ryzen_smu_pm_delta_word*)(dst + sizeof(hdr));
+
+        // The values of the changed words are stored in the order of the bitmap.
+        for (i = 0; i < DIV_ROUND_UP(size / sizeof(u32), 32); i++) {
+            for (bits = cur->bitmap[i]; bits; bits &= bits - 1, n++) {
+                words[n].offset = (i * 32 + __ffs(bits)) * sizeof(u32);
+                words[n].value = cur->values[n];
+            }
+        }
+
+        hdr.size = n * sizeof(*words);
+    }
+
+    memcpy(dst, &hdr, sizeof(hdr));
+
+    return sizeof(hdr) + hdr.size;
+}
+
+/**
+ * Decodes the history in chunks of PM_DRAIN_CHUNK samples under the lock of the snapshot, copying
+ *  each chunk to userspace once the lock was dropped so that neither large drains nor faulting
+ *  readers hold up the sampler and other readers.
+ */
+static long smu_pm_dev_drain(struct smu_pm_snapshot* snap, struct ryzen_smu_pm_drain __user* udrain,
+    bool delta) {
+    struct ryzen_smu_pm_drain drain;
+    struct pm_delta_cursor cur;
+    u32 count = 0, used = 0, chunk, len, n, size, entry_max;
+    bool full = true;
+    u64 seq, next, lost = 0;
+    u8 __user* buf;
+    u8* bounce;
+    long ret = 0;
+
+    if (copy_from_user(&drain, udrain, sizeof(drain)))
+        return -EFAULT;
+
+    buf = u64_to_user_ptr(drain.buf);
+
+    // The history is set up along with the device and never changes size.
+    if (!snap->history_mem)
+        return -EOPNOTSUPP;
+
+    size = snap->history.words * sizeof(u32);
+
+    entry_max = delta ? sizeof(struct ryzen_smu_pm_delta) + ALIGN(size, 8) :
+        ALIGN(sizeof(struct ryzen_smu_pm_sample) + size, 8);
+
+    // The table being decoded followed by the entries of a chunk, zeroed so padding doesn't leak.
+    bounce = vzalloc(size + PM_DRAIN_CHUNK * (size_t)entry_max);
+    if (!bounce)
+        return -ENOMEM;
+
+    cur.table = (u32*)bounce;
+    next = drain.seq;
+
+    do {
+        mutex_lock(&snap->lock);
+
+        // Samples older than the history were overwritten before they could be drained, which may
+        //  also happen while the previous chunk was copied.
+        // A cursor ahead of the history, e.g. one from before the module was reloaded, is moved back
+        //  to the newest sample without anything being lost.
+        seq = pm_delta_seek(&snap->history, &cur, next);
+        if (seq > next) {
+            lost += seq - next;
+
+            // Deltas against the last entry stored no longer apply.
+            full = true;
+        }
+
+        for (chunk = 0, len = 0; chunk < PM_DRAIN_CHUNK && pm_delta_next(&snap->history, &cur); chunk++) {
+            n = smu_pm_drain_entry(bounce + size + len, &cur, seq, size, delta, full);
+
+            // Only whole entries are stored, the next drain resumes from this one.
+            if ((u64)used + len + n > drain.size)
+                break;
+
+            len += n;
+            seq++;
+            full = false;
+        }
+
+        mutex_unlock(&snap->lock);
+
+        if (len && copy_to_user(buf + used, bounce + size, len)) {
+            ret = -EFAULT;
+            goto BREAK_OUT;
+        }
+
+        used += len;
+        count += chunk;
+        next = seq;
+    } while (chunk == PM_DRAIN_CHUNK);
+
+    drain.count = count;
+    drain.seq = next;
+    drain.lost = min_t(u64, lost, U32_MAX);
+
+    if (delta)
+        drain.used = used;
+    else
+        drain.stride = entry_max;
+
+    if (copy_to_user(udrain, &drain, sizeof(drain)))
+        ret = -EFAULT;
+
+BREAK_OUT:
+    vfree(bounce);
+
+    return ret;
+}
+
+static int smu_pm_dev_open(struct inode* inode, struct file* filp) {
+    struct ryzen_dev_node* dnode = container_of(filp->private_data, struct ryzen_dev_node, misc);
+    struct smu_pm_node* node = container_of(dnode, struct smu_pm_node, dnode);
+    struct smu_pm_file* file;
+
+    file = kzalloc(sizeof(*file), GFP_KERNEL);
+    if (!file)
+        return -ENOMEM;
+
+    // Opens are serialized against the removal of the device by the misc core.
+    kref_get(&node->snap->ref);
+
+    // Only updates made after opening are reported by poll().
+    file->snap = node->snap;
+    file->seen = READ_ONCE(node->snap->hdr->seq);
+    file->max_age_us = RYZEN_SMU_PM_MAX_AGE_DEFAULT;
+
+    filp->private_data = file;
+
+    return nonseekable_open(inode, filp);
+}
+
+static int smu_pm_dev_release(struct inode* inode, struct file* filp) {
+    struct smu_pm_file* file = filp->private_data;
+
+    smu_pm_snapshot_put(file->snap);
+    kfree(file);
+
+    return 0;
+}
+
+/**
+ * Copies the header and table of the snapshot from the position of the file and marks the snapshot
+ *  as seen by poll(). Once the snapshot was read to its end, reads return 0 until it is updated,
+ *  after which reading starts over from the start of the new snapshot.
+ * Readers using the mapping may read 0 bytes to mark the snapshot as seen.
+ */
+static ssize_t smu_pm_dev_read(struct file* filp, char __user* buf, size_t count, loff_t* off) {
+    struct smu_pm_file* file = filp->private_data;
+    struct smu_pm_snapshot* snap = file->snap;
+    size_t total;
+    ssize_t ret;
+
+    mutex_lock(&snap->lock);
+
+    if (snap->hdr->seq != file->seen) {
+        file->seen = snap->hdr->seq;
+        *off = 0;
+    }
+
+    total = snap->hdr->data_offset + snap->hdr->size;
+
+    if (*off >= total) {
+        ret = 0;
+        goto BREAK_OUT;
+    }
+
+    ret = min_t(size_t, count, total - *off);
+
+    if (copy_to_user(buf, (u8*)snap->hdr + *off, ret))
+        ret = -EFAULT;
+    else
+        *off += ret;
+
+BREAK_OUT:
+    mutex_unlock(&snap->lock);
+
+    return ret;
+}
+
+static void smu_pm_snapshot_poll_work(struct work_struct* work) {
+    struct smu_pm_snapshot* snap = container_of(to_delayed_work(work), struct smu_pm_snapshot, poll_work);
+
+    // Pollers are woken by a successful refresh. A failed one is retried while they still wait, as
+    //  they would otherwise never poll again. The reference is kept by the requeued work.
+    if (smu_pm_snapshot_refresh(snap, 0) && READ_ONCE(snap->dev) && wq_has_sleeper(&snap->wait) &&
+        schedule_delayed_work(&snap->poll_work, usecs_to_jiffies(smu_pm_default_max_age())))
+        return;
+
+    smu_pm_snapshot_put(snap);
+}
+
+/**
+ * Schedules a refresh of the snapshot for when it becomes older than [max_age_us], so that pollers
+ *  are woken without relying on the sampler or other readers.
+ */
+static void smu_pm_snapshot_poll_refresh(struct smu_pm_snapshot* snap, u32 max_age_us) {
+    u64 age_us, delay_us = 0;
+
+    mutex_lock(&snap->lock);
+
+    // Under the lock, as the device being removed cancels the work after clearing it.
+    if (snap->dev) {
+        age_us = div_u64(ktime_get_ns() - snap->hdr->timestamp_ns, NSEC_PER_USEC);
+
+        if (snap->hdr->size && age_us < max_age_us)
+            delay_us = max_age_us - age_us;
+
+        if (schedule_delayed_work(&snap->poll_work, usecs_to_jiffies(min_t(u64, delay_us, U32_MAX))))
+            kref_get(&snap->ref);
+    }
+
+    mutex_unlock(&snap->lock);
+}
+
+static __poll_t smu_pm_dev_poll(struct file* filp, poll_table* wait) {
+    struct smu_pm_file* file = filp->private_data;
+    struct smu_pm_snapshot* snap = file->snap;
+    __poll_t mask = 0;
+    u32 max_age_us;
+
+    poll_wait(filp, &snap->wait, wait);
+
+    if (READ_ONCE(snap->hdr->seq) != READ_ONCE(file->seen))
+        mask |= EPOLLIN | EPOLLRDNORM;
+
+    // Updates stopped as the device was removed.
+    if (!READ_ONCE(snap->dev))
+        mask |= EPOLLHUP;
+
+    // Without the sampler, nothing else may ever refresh the snapshot, so pollers waiting for an
+    //  update have it refreshed once it is older than the file accepts.
+    if (!mask) {
+        max_age_us = READ_ONCE(file->max_age_us);
+
+        if (max_age_us == RYZEN_SMU_PM_MAX_AGE_DEFAULT)
+            max_age_us = smu_pm_default_max_age();
+
+        smu_pm_snapshot_poll_refresh(snap, max_age_us);
+    }
+
+    return mask;
+}
+
+static int smu_pm_dev_mmap(struct file* filp, struct vm_area_struct* vma) {
+    struct smu_pm_file* file = filp->private_data;
+    struct smu_pm_snapshot* snap = file->snap;
+
+    // The snapshot is shared by every reader so it may never be written to.
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+    // Fails for mappings exceeding the snapshot.
+    return remap_vmalloc_range(vma, snap->hdr, vma->vm_pgoff);
+}
+
+static long smu_pm_dev_history_info(struct smu_pm_snapshot* snap, struct ryzen_smu_pm_history __user* uinfo) {
+    struct ryzen_smu_pm_history info = { 0 };
+    u32 i;
+
+    if (!snap->history_mem)
+        return -EOPNOTSUPP;
+
+    mutex_lock(&snap->lock);
+
+    info.oldest_seq = pm_delta_oldest(&snap->history);
+    info.next_seq = snap->history.next_seq;
+    info.size = (u64)snap->history.seg_count * snap->history.seg_size;
+
+    for (i = 0; i < snap->history.seg_count; i++)
+        info.used += snap->history.segs[i].used;
+
+    mutex_unlock(&snap->lock);
+
+    return copy_to_user(uinfo, &info, sizeof(info)) ? -EFAULT : 0;
+}
+
+static long smu_pm_dev_ioctl(struct file* filp, unsigned int cmd, unsigned long arg) {
+    struct smu_pm_file* file = filp->private_data;
+    struct smu_pm_snapshot* snap = file->snap;
+
+    u32 max_age_us;
+
+    switch (cmd) {
+        case RYZEN_SMU_PM_IOC_REFRESH:
+            max_age_us = READ_ONCE(file->max_age_us);
+
+            if (max_age_us == RYZEN_SMU_PM_MAX_AGE_DEFAULT)
+                max_age_us = smu_pm_default_max_age();
+
+            return smu_pm_snapshot_refresh(snap, max_age_us);
+        case RYZEN_SMU_PM_IOC_SET_MAX_AGE:
+            if (get_user(max_age_us, (u32 __user*)arg))
+                return -EFAULT;
+
+            WRITE_ONCE(file->max_age_us, max_age_us);
+            return 0;
+        case RYZEN_SMU_PM_IOC_DRAIN:
+            return smu_pm_dev_drain(snap, (struct ryzen_smu_pm_drain __user*)arg, false);
+        case RYZEN_SMU_PM_IOC_DRAIN_DELTA:
+            return smu_pm_dev_drain(snap, (struct ryzen_smu_pm_drain __user*)arg, true);
+        case RYZEN_SMU_PM_IOC_HISTORY_INFO:
+            return smu_pm_dev_history_info(snap, (struct ryzen_smu_pm_history __user*)arg);
+        default:
+            return -ENOTTY;
+    }
+}
+
+static const struct file_operations smu_pm_dev_fops = {
+    .owner          = THIS_MODULE,
+    .open           = smu_pm_dev_open,
+    .release        = smu_pm_dev_release,
+    .read           = smu_pm_dev_read,
+    .poll           = smu_pm_dev_poll,
+    .mmap           = smu_pm_dev_mmap,
+    .unlocked_ioctl = smu_pm_dev_ioctl,
+    .compat_ioctl   = ryzen_dev_compat_ioctl,
+};
+
+int smu_pm_dev_read_word(u32 node, u32 offset, u32 max_age_us, u32* value) {
+    struct smu_pm_snapshot* snap;
+    int err;
+
+    if (node >= SMU_MAX_NODES || !smu_pm_nodes[node].snap)
+        return -ENODEV;
+
+    snap = smu_pm_nodes[node].snap;
+
+    if (max_age_us == RYZEN_SMU_PM_MAX_AGE_DEFAULT)
+        max_age_us = smu_pm_default_max_age();
+
+    // A stale snapshot is still worth returning, the refresh may be retried by the next read.
+    err = smu_pm_snapshot_refresh(snap, max_age_us);
+
+    mutex_lock(&snap->lock);
+
+    if (!snap->hdr->size)
+        err = err ? err : -ENODEV;
+    else if (offset > snap->hdr->size - sizeof(u32) || offset % sizeof(u32))
+        err = -EINVAL;
+    else {
+        *value = *(u32*)(snap->table + offset);
+        err = 0;
+    }
+
+    mutex_unlock(&snap->lock);
+
+    return err;
+}
+
+static void smu_pm_snapshot_refresh_work(struct work_struct* work) {
+    struct smu_pm_snapshot* snap = container_of(work, struct smu_pm_snapshot, refresh_work);
+
+    smu_pm_snapshot_refresh(snap, smu_pm_default_max_age());
+}
+
+int smu_pm_dev_peek_word(u32 node, u32 offset, u32* value) {
+    struct smu_pm_snapshot* snap;
+    u32 seq, size;
+    u64 timestamp_ns;
+
+    if (node >= SMU_MAX_NODES || !smu_pm_nodes[node].snap)
+        return -ENODEV;
+
+    snap = smu_pm_nodes[node].snap;
+
+    // Same protocol as userspace readers of the mapping, except that waiting for a refresh in
+    //  progress would spin for as long as the SMU takes, so the caller is told to retry later.
+    seq = READ_ONCE(snap->hdr->seq);
+    if (seq & 1)
+        return -EAGAIN;
+
+    smp_rmb();
+
+    size = snap->hdr->size;
+    timestamp_ns = snap->hdr->timestamp_ns;
+
+    if (size && offset <= size - sizeof(u32) && !(offset % sizeof(u32)))
+        *value = READ_ONCE(*(u32*)(snap->table + offset));
+
+    smp_rmb();
+
+    if (READ_ONCE(snap->hdr->seq) != seq)
+        return -EAGAIN;
+
+    if (ktime_get_ns() - timestamp_ns > (u64)smu_pm_default_max_age() * NSEC_PER_USEC)
+        schedule_work(&snap->refresh_work);
+
+    if (!size)
+        return -ENODEV;
+
+    if (offset > size - sizeof(u32) || offset % sizeof(u32))
+        return -EINVAL;
+
+    return 0;
+}
+
+int smu_pm_dev_register(struct pci_dev* dev, u32 node, u32 version) {
+    struct smu_pm_snapshot* snap;
+    struct smu_pm_node* pnode;
+    int err;
+
+    BUILD_BUG_ON(sizeof(struct ryzen_smu_pm_header) > RYZEN_SMU_PM_DATA_OFFSET);
+    BUILD_BUG_ON(RYZEN_SMU_PM_DATA_OFFSET + PM_TABLE_MAX_SIZE > RYZEN_SMU_PM_MAP_SIZE);
+
+    if (node >= SMU_MAX_NODES)
+        return -EINVAL;
+
+    // Consider it registered if this is called twice for the same node.
+    pnode = &smu_pm_nodes[node];
+    if (pnode->snap)
+        return 0;
+
+    snap = kzalloc(sizeof(*snap), GFP_KERNEL);
+    if (!snap)
+        return -ENOMEM;
+
+    // Zeroed and suitable for remap_vmalloc_range().
+    snap->hdr = vmalloc_user(RYZEN_SMU_PM_MAP_SIZE);
+    if (!snap->hdr) {
+        kfree(snap);
+        return -ENOMEM;
+    }
+
+    kref_init(&snap->ref);
+    mutex_init(&snap->lock);
+    init_waitqueue_head(&snap->wait);
+    INIT_WORK(&snap->refresh_work, smu_pm_snapshot_refresh_work);
+    INIT_DELAYED_WORK(&snap->poll_work, smu_pm_snapshot_poll_work);
+
+    snap->dev = dev;
+    snap->node = node;
+    snap->table = (u8*)snap->hdr + RYZEN_SMU_PM_DATA_OFFSET;
+
+    snap->hdr->version = version;
+    snap->hdr->data_offset = RYZEN_SMU_PM_DATA_OFFSET;
+
+    // Provide valid contents to the first readers, which also determines the size of the table.
+    smu_pm_snapshot_refresh(snap, 0);
+
+    // The history is optional, the snapshot remains usable without it.
+    if (pm_history_len && snap->hdr->size)
+        smu_pm_snapshot_history_init(snap, node);
+
+    // Started even while sampling is disabled, as the interval may be set at runtime.
+    mutex_lock(&smu_pm_sampler_lock);
+
+    snap->sampler = kthread_run(smu_pm_sampler, snap, "ryzen_smu%u_pm", node);
+
+    if (IS_ERR(snap->sampler)) {
+        pr_warn("Unable to start the PM table sampler of node %d", node);
+        snap->sampler = NULL;
+    }
+
+    mutex_unlock(&smu_pm_sampler_lock);
+
+    pnode->snap = snap;
+    pnode->dnode.dev = dev;
+    pnode->dnode.node = node;
+    ryzen_dev_node_name(&pnode->dnode, RYZEN_SMU_PM_DEV_NAME);
+
+    pnode->dnode.misc.minor = MISC_DYNAMIC_MINOR;
+    pnode->dnode.misc.name = pnode->dnode.name;
+    pnode->dnode.misc.fops = &smu_pm_dev_fops;
+    pnode->dnode.misc.mode = S_IRUSR;
+
+    err = misc_register(&pnode->dnode.misc);
+    if (err) {
+        mutex_lock(&smu_pm_sampler_lock);
+
+        if (snap->sampler)
+            kthread_stop(snap->sampler);
+
+        mutex_unlock(&smu_pm_sampler_lock);
+
+        smu_pm_snapshot_put(snap);
+        memset(pnode, 0, sizeof(*pnode));
+    }
+
+    return err;
+}
+
+void smu_pm_dev_unregister(u32 node) {
+    struct smu_pm_snapshot* snap;
+
+    if (node >= SMU_MAX_NODES || !smu_pm_nodes[node].snap)
+        return;
+
+    snap = smu_pm_nodes[node].snap;
+
+    misc_deregister(&smu_pm_nodes[node].dnode.misc);
+
+    mutex_lock(&smu_pm_sampler_lock);
+
+    if (snap->sampler)
+        kthread_stop(snap->sampler);
+
+    snap->sampler = NULL;
+
+    mutex_unlock(&smu_pm_sampler_lock);
+
+    // Users of smu_pm_dev_peek_word() are gone by now, so the work is no longer scheduled.
+    cancel_work_sync(&snap->refresh_work);
+
+    // Files which are still open keep their mappings but no longer receive updates.
+    mutex_lock(&snap->lock);
+    snap->dev = NULL;
+    mutex_unlock(&snap->lock);
+
+    // No longer scheduled by pollers, the reference of a pending refresh is dropped in its place.
+    if (cancel_delayed_work_sync(&snap->poll_work))
+        smu_pm_snapshot_put(snap);
+
+    wake_up_interruptible(&snap->wait);
+
+    smu_pm_snapshot_put(snap);
+
+    memset(&smu_pm_nodes[node], 0, sizeof(smu_pm_nodes[node]));
+}
+
+void smu_pm_dev_sampler_wake(void) {
+    u32 i;
+
+    mutex_lock(&smu_pm_sampler_lock);
+
+    for (i = 0; i < SMU_MAX_NODES; i++)
+        if (smu_pm_nodes[i].snap && smu_pm_nodes[i].snap->sampler)
+            wake_up_process(smu_pm_nodes[i].snap->sampler);
+
+    mutex_unlock(&smu_pm_sampler_lock);
+}
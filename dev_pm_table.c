@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Access Device */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/miscdevice.h>
+
+#include "smu.h"
+#include "dev.h"
+
+static struct ryzen_dev_node smu_pm_table_dev_nodes[SMU_MAX_NODES];
+
+static struct pci_dev* smu_pm_table_dev_pci(struct file* filp) {
+    return container_of(filp->private_data, struct ryzen_dev_node, misc)->dev;
+}
+
+// The file offset is the offset within the PM table, allowing single fields to be read with pread().
+static ssize_t smu_pm_table_dev_read(struct file* filp, char __user* buf, size_t count, loff_t* ppos) {
+    enum smu_return_val ret;
+    size_t len = count;
+
+    ret = smu_read_pm_table_user(smu_pm_table_dev_pci(filp), buf, *ppos, &len);
+
+    switch (ret) {
+        case SMU_Return_OK:
+            *ppos += len;
+            return len;
+        case SMU_Return_InvalidArgument:
+            return *ppos < 0 ? -EINVAL : -EFAULT;
+        case SMU_Return_Unsupported:
+            return -ENODEV;
+        case SMU_Return_InsufficientSize:
+            return -ENOMEM;
+        default:
+            return -EIO;
+    }
+}
+
+static loff_t smu_pm_table_dev_llseek(struct file* filp, loff_t offset, int whence) {
+    return no_seek_end_llseek_size(filp, offset, whence, PM_TABLE_MAX_SIZE);
+}
+
+static const struct file_operations smu_pm_table_dev_fops = {
+    .owner          = THIS_MODULE,
+    .read           = smu_pm_table_dev_read,
+    .llseek         = smu_pm_table_dev_llseek,
+};
+
+int smu_pm_table_dev_register(struct pci_dev* dev, u32 node) {
+    struct ryzen_dev_node* dnode;
+    int err;
+
+    if (node >= SMU_MAX_NODES)
+        return -EINVAL;
+
+    // Consider it registered if this is called twice for the same node.
+    dnode = &smu_pm_table_dev_nodes[node];
+    if (dnode->dev)
+        return 0;
+
+    dnode->dev = dev;
+    dnode->node = node;
+    ryzen_dev_node_name(dnode, RYZEN_SMU_PM_TABLE_DEV_NAME);
+
+    dnode->misc.minor = MISC_DYNAMIC_MINOR;
+    dnode->misc.name = dnode->name;
+    dnode->misc.fops = &smu_pm_table_dev_fops;
+    dnode->misc.mode = S_IRUSR;
+
+    err = misc_register(&dnode->misc);
+    if (err)
+        dnode->dev = NULL;
+
+    return err;
+}
+
+void smu_pm_table_dev_unregister(u32 node) {
+    if (node >= SMU_MAX_NODES || !smu_pm_table_dev_nodes[node].dev)
+        return;
+
+    misc_deregister(&smu_pm_table_dev_nodes[node].misc);
+
+    memset(&smu_pm_table_dev_nodes[node], 0, sizeof(smu_pm_table_dev_nodes[node]));
+}
@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMN Access Device */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/miscdevice.h>
+
+#include "smu.h"
+#include "dev.h"
+
+static struct ryzen_dev_node smn_dev_nodes[SMU_MAX_NODES];
+
+// The SMN address space is 32 bits wide.
+#define SMN_DEV_SIZE                       (1ULL << 32)
+
+// Amount of words transferred under a single acquisition of the SMN lock.
+#define SMN_DEV_CHUNK_WORDS                RYZEN_SMN_BATCH_MAX
+
+static struct pci_dev* smn_dev_pci(struct file* filp) {
+    return container_of(filp->private_data, struct ryzen_dev_node, misc)->dev;
+}
+
+static ssize_t smn_dev_rw(struct file* filp, char __user* ubuf, size_t count, loff_t* ppos,
+    int write) {
+    u32 *buf, words, accessed;
+    size_t done, len;
+    loff_t pos = *ppos;
+    ssize_t err = 0;
+
+    // The file offset is the SMN address, which must be accessed in aligned 32 bit words.
+    if (pos < 0 || !IS_ALIGNED(pos, sizeof(u32)) || !IS_ALIGNED(count, sizeof(u32)))
+        return -EINVAL;
+
+    if (pos >= SMN_DEV_SIZE)
+        return 0;
+
+    count = min_t(u64, count, SMN_DEV_SIZE - pos);
+    if (!count)
+        return 0;
+
+    buf = kmalloc(SMN_DEV_CHUNK_WORDS * sizeof(u32), GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    for (done = 0; done < count; done += len) {
+        len = min_t(size_t, count - done, SMN_DEV_CHUNK_WORDS * sizeof(u32));
+        words = len / sizeof(u32);
+
+        if (write && copy_from_user(buf, ubuf + done, len)) {
+            err = -EFAULT;
+            break;
+        }
+
+        if (smu_smn_rw_range(smn_dev_pci(filp), pos + done, buf, words, write, &accessed) !=
+            SMU_Return_OK) {
+            // Report the words of the chunk which were accessed before the failure, as a short
+            //  transfer, so that userspace retries from the failing address.
+            len = accessed * sizeof(u32);
+            err = -EIO;
+
+            if (!write && len && copy_to_user(ubuf + done, buf, len)) {
+                len = 0;
+                err = -EFAULT;
+            }
+
+            done += len;
+            break;
+        }
+
+        if (!write && copy_to_user(ubuf + done, buf, len)) {
+            err = -EFAULT;
+            break;
+        }
+    }
+
+    kfree(buf);
+
+    *ppos = pos + done;
+
+    return done ? done : err;
+}
+
+static ssize_t smn_dev_read(struct file* filp, char __user* buf, size_t count, loff_t* ppos) {
+    return smn_dev_rw(filp, buf, count, ppos, 0);
+}
+
+static ssize_t smn_dev_write(struct file* filp, const char __user* buf, size_t count, loff_t* ppos) {
+    return smn_dev_rw(filp, (char __user*)buf, count, ppos, 1);
+}
+
+static loff_t smn_dev_llseek(struct file* filp, loff_t offset, int whence) {
+    return no_seek_end_llseek_size(filp, offset, whence, SMN_DEV_SIZE);
+}
+
+static long smn_dev_batch(struct file* filp, struct ryzen_smn_batch __user* ubatch) {
+    struct ryzen_smn_batch batch;
+    struct ryzen_smn_op* ops;
+    size_t size;
+    long ret = 0;
+
+    if (copy_from_user(&batch, ubatch, sizeof(batch)))
+        return -EFAULT;
+
+    // Reserved for extensions, which must be opted into explicitly.
+    if (batch.reserved)
+        return -EINVAL;
+
+    if (!batch.count || batch.count > RYZEN_SMN_BATCH_MAX)
+        return -EINVAL;
+
+    size = batch.count * sizeof(*ops);
+
+    ops = kmalloc(size, GFP_KERNEL);
+    if (!ops)
+        return -ENOMEM;
+
+    if (copy_from_user(ops, u64_to_user_ptr(batch.ops), size)) {
+        ret = -EFAULT;
+        goto BREAK_OUT;
+    }
+
+    // Failures are reported per access through the status fields.
+    smu_smn_rw_batch(smn_dev_pci(filp), ops, batch.count);
+
+    if (copy_to_user(u64_to_user_ptr(batch.ops), ops, size))
+        ret = -EFAULT;
+
+BREAK_OUT:
+    kfree(ops);
+
+    return ret;
+}
+
+static long smn_dev_ioctl(struct file* filp, unsigned int cmd, unsigned long arg) {
+    switch (cmd) {
+        case RYZEN_SMN_IOC_BATCH:
+            return smn_dev_batch(filp, (struct ryzen_smn_batch __user*)arg);
+        default:
+            return -ENOTTY;
+    }
+}
+
+static const struct file_operations smn_dev_fops = {
+    .owner          = THIS_MODULE,
+    .read           = smn_dev_read,
+    .write          = smn_dev_write,
+    .llseek         = smn_dev_llseek,
+    .unlocked_ioctl = smn_dev_ioctl,
+    // All structures have the same layout on 32 and 64 bit.
+    .compat_ioctl   = ryzen_dev_compat_ioctl,
+};
+
+int smn_dev_register(struct pci_dev* dev, u32 node) {
+    struct ryzen_dev_node* dnode;
+    int err;
+
+    if (node >= SMU_MAX_NODES)
+        return -EINVAL;
+
+    // Consider it registered if this is called twice for the same node.
+    dnode = &smn_dev_nodes[node];
+    if (dnode->dev)
+        return 0;
+
+    dnode->dev = dev;
+    dnode->node = node;
+    ryzen_dev_node_name(dnode, RYZEN_SMN_DEV_NAME);
+
+    dnode->misc.minor = MISC_DYNAMIC_MINOR;
+    dnode->misc.name = dnode->name;
+    dnode->misc.fops = &smn_dev_fops;
+    dnode->misc.mode = S_IRUSR | S_IWUSR;
+
+    err = misc_register(&dnode->misc);
+    if (err)
+        dnode->dev = NULL;
+
+    return err;
+}
+
+void smn_dev_unregister(u32 node) {
+    if (node >= SMU_MAX_NODES || !smn_dev_nodes[node].dev)
+        return;
+
+    misc_deregister(&smn_dev_nodes[node].misc);
+
+    memset(&smn_dev_nodes[node], 0, sizeof(smn_dev_nodes[node]));
+}
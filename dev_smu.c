@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Command Device */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
+#include <linux/miscdevice.h>
+
+#include "smu.h"
+#include "dev.h"
+#include "queue.h"
+
+static struct ryzen_dev_node smu_dev_nodes[SMU_MAX_NODES];
+
+static int smu_dev_open(struct inode* inode, struct file* filp) {
+    struct ryzen_dev_node* dnode = container_of(filp->private_data, struct ryzen_dev_node, misc);
+    struct smu_queue_client* client;
+
+    client = smu_queue_client_alloc(dnode->dev, dnode->node);
+    if (!client)
+        return -ENOMEM;
+
+    filp->private_data = client;
+
+    return nonseekable_open(inode, filp);
+}
+
+static int smu_dev_release(struct inode* inode, struct file* filp) {
+    smu_queue_client_put(filp->private_data);
+    return 0;
+}
+
+static ssize_t smu_dev_write(struct file* filp, const char __user* buf, size_t count, loff_t* ppos) {
+    struct smu_queue_client* client = filp->private_data;
+    struct ryzen_smu_request req;
+    size_t done;
+    int err;
+
+    if (!count || count % sizeof(req))
+        return -EINVAL;
+
+    for (done = 0; done < count; done += sizeof(req)) {
+        if (copy_from_user(&req, buf + done, sizeof(req))) {
+            err = -EFAULT;
+            goto BREAK_OUT;
+        }
+
+        while ((err = smu_queue_submit(client, &req)) == -EAGAIN) {
+            // Partially accepted writes return what was queued instead of blocking.
+            if (done || (filp->f_flags & O_NONBLOCK))
+                goto BREAK_OUT;
+
+            if (wait_event_interruptible(*smu_queue_client_wait(client),
+                smu_queue_can_submit(client)))
+                return -ERESTARTSYS;
+        }
+
+        if (err)
+            goto BREAK_OUT;
+    }
+
+    return done;
+
+BREAK_OUT:
+    return done ? done : err;
+}
+
+static ssize_t smu_dev_read(struct file* filp, char __user* buf, size_t count, loff_t* ppos) {
+    struct smu_queue_client* client = filp->private_data;
+    struct ryzen_smu_request req;
+    size_t done;
+
+    if (count < sizeof(req))
+        return -EINVAL;
+
+    while (!smu_queue_has_completions(client)) {
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+
+        if (wait_event_interruptible(*smu_queue_client_wait(client),
+            smu_queue_has_completions(client)))
+            return -ERESTARTSYS;
+    }
+
+    for (done = 0; done + sizeof(req) <= count && smu_queue_pop(client, &req); done += sizeof(req)) {
+        // The request was already removed, there's nothing better to do than report the fault.
+        if (copy_to_user(buf + done, &req, sizeof(req)))
+            return done ? done : -EFAULT;
+    }
+
+    return done;
+}
+
+static __poll_t smu_dev_poll(struct file* filp, poll_table* wait) {
+    struct smu_queue_client* client = filp->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(filp, smu_queue_client_wait(client), wait);
+
+    if (smu_queue_has_completions(client))
+        mask |= EPOLLIN | EPOLLRDNORM;
+
+    if (smu_queue_can_submit(client))
+        mask |= EPOLLOUT | EPOLLWRNORM;
+
+    return mask;
+}
+
+static long smu_dev_ioctl(struct file* filp, unsigned int cmd, unsigned long arg) {
+    struct smu_queue_client* client = filp->private_data;
+    struct ryzen_smu_request req;
+    int err;
+
+    switch (cmd) {
+        case RYZEN_SMU_IOC_COMMAND:
+            if (copy_from_user(&req, (void __user*)arg, sizeof(req)))
+                return -EFAULT;
+
+            err = smu_queue_execute_now(client, &req);
+            if (err)
+                return err;
+
+            if (copy_to_user((void __user*)arg, &req, sizeof(req)))
+                return -EFAULT;
+
+            return 0;
+        default:
+            return -ENOTTY;
+    }
+}
+
+static const struct file_operations smu_dev_fops = {
+    .owner          = THIS_MODULE,
+    .open           = smu_dev_open,
+    .release        = smu_dev_release,
+    .read           = smu_dev_read,
+    .write          = smu_dev_write,
+    .poll           = smu_dev_poll,
+    .unlocked_ioctl = smu_dev_ioctl,
+    .compat_ioctl   = ryzen_dev_compat_ioctl,
+};
+
+int smu_dev_register(struct pci_dev* dev, u32 node) {
+    struct ryzen_dev_node* dnode;
+    int err;
+
+    if (node >= SMU_MAX_NODES)
+        return -EINVAL;
+
+    // Consider it registered if this is called twice for the same node.
+    dnode = &smu_dev_nodes[node];
+    if (dnode->dev)
+        return 0;
+
+    err = smu_queue_init(node);
+    if (err)
+        return err;
+
+    dnode->dev = dev;
+    dnode->node = node;
+    ryzen_dev_node_name(dnode, RYZEN_SMU_DEV_NAME);
+
+    dnode->misc.minor = MISC_DYNAMIC_MINOR;
+    dnode->misc.name = dnode->name;
+    dnode->misc.fops = &smu_dev_fops;
+    dnode->misc.mode = S_IRUSR | S_IWUSR;
+
+    err = misc_register(&dnode->misc);
+    if (err) {
+        dnode->dev = NULL;
+        smu_queue_cleanup(node);
+        return err;
+    }
+
+    return 0;
+}
+
+void smu_dev_unregister(u32 node) {
+    struct ryzen_dev_node* dnode;
+
+    if (node >= SMU_MAX_NODES || !smu_dev_nodes[node].dev)
+        return;
+
+    dnode = &smu_dev_nodes[node];
+
+    misc_deregister(&dnode->misc);
+    smu_queue_cleanup(node);
+
+    memset(dnode, 0, sizeof(*dnode));
+}
@@ -12,8 +12,15 @@
 #include <linux/sysfs.h>
 #include <uapi/linux/stat.h>
 #include <linux/version.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 
 #include "smu.h"
+#include "dev.h"
+#include "stats.h"
+#include "pm_fields.h"
+#include "pm_hwmon.h"
+#include "pm_perf.h"
 
 #ifndef KBUILD_MODNAME
     #define KBUILD_MODNAME "ryzen_smu"
@@ -31,8 +38,6 @@ MODULE_LICENSE("GPL");
 #define PCI_DEVICE_ID_AMD_17H_M60H_ROOT    0x1630
 #define PCI_DEVICE_ID_AMD_17H_M30H_ROOT    0x1480
 
-#define MAX_ATTRS_LEN                      12
-
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 19, 0)
     #error "Unsupported kernel version. Minimum: v4.19"
 #endif
@@ -45,9 +50,35 @@ MODULE_LICENSE("GPL");
     static struct kobj_attribute dev_attr_##attr = \
         __ATTR(attr, S_IRUSR | S_IWUSR, attr##_show, attr##_store);
 
-static struct ryzen_smu_data {
+// Binary attributes, which may be larger than a page. From 6.13 their callbacks take a const
+//  attribute, which kernels before 6.17 only accept through read_new.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    #define __BIN_ATTR_CONST const
+#else
+    #define __BIN_ATTR_CONST
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0) && LINUX_VERSION_CODE < KERNEL_VERSION(6, 17, 0)
+    #define __BIN_ATTR_READ read_new
+#else
+    #define __BIN_ATTR_READ read
+#endif
+
+#define __RO_BIN_ATTR(_name) \
+    static struct bin_attribute dev_attr_##_name = { \
+        .attr = { .name = __stringify(_name), .mode = S_IRUSR }, \
+        .__BIN_ATTR_READ = _name##_read, \
+    };
+
+/**
+ * State of a single bound SMU, one per root complex hosting one.
+ */
+struct ryzen_smu_data {
     struct pci_dev*         device;
-    struct kobject*         drv_kobj;
+    u32                     node;
+
+    // ryzen_smu_drv/nodeN
+    struct kobject*         node_kobj;
 
     char                    smu_version[64];
     smu_req_args_t          smu_args;
@@ -55,38 +86,78 @@ static struct ryzen_smu_data {
 
     u32                     smn_result;
 
-    u8*                     pm_table;
+    // Optional features, used to hide the attributes of unsupported ones.
+    bool                    rsmu_supported;
+    bool                    pm_table_supported;
+
     u32                     pm_table_version;
     size_t                  pm_table_read_size;
-} g_driver = {
-    .device               = NULL,
 
-    .drv_kobj             = NULL,
+    // Discovers the RSMU mailbox and the PM table after the probe, see ryzen_smu_init_work().
+    struct work_struct      init_work;
+    ktime_t                 probe_start;
 
-    .smu_version          = { 0 },
-    .smu_args             = { .args = { 0, 0, 0, 0, 0, 0 } },
-    .smu_rsp              = SMU_Return_OK,
+    // ryzen_smu_drv/nodeN/pm_fields, the hwmon device and the perf PMU, present when the layout of
+    //  the PM table is known.
+    struct pm_fields_dir*   pm_fields;
+    struct pm_hwmon*        pm_hwmon;
+    struct pm_perf*         pm_perf;
+};
 
-    .smn_result           = 0,
+static struct {
+    // ryzen_smu_drv, which also exposes the attributes of node 0 for compatibility.
+    struct kobject*         drv_kobj;
 
-    .pm_table             = NULL,
-    .pm_table_version     = 0,
-    .pm_table_read_size   = PM_TABLE_MAX_SIZE,
+    struct ryzen_smu_data*  nodes[SMU_MAX_NODES];
+} g_driver = {
+    .drv_kobj             = NULL,
+    .nodes                = { NULL },
 };
 
 /* SMU Command Parameters. */
-uint smu_timeout_attempts = 8192;
+uint smu_timeout_us = SMU_TIMEOUT_DEFAULT_US;
+
+/* Whether results of SMU getter commands which can't change may be cached. */
+bool smu_cache = true;
+
+/* Minimum interval between PM table refreshes. */
+uint pm_refresh_interval_us = 1000;
+
+/* How the PM table is copied out of its mapping, see enum smu_pm_copy_strategy. */
+uint pm_copy_strategy = SMU_PM_COPY_FROMIO;
+
+/* SMN Access Parameters. */
+uint smn_lanes = 2;
+
+/* PM Table Sampler Parameters. */
+uint pm_sample_interval_us = 0;
+uint pm_history_len = 0;
 
 static ssize_t attr_store_null(struct kobject *kobj, struct kobj_attribute *attr, const char *buff, size_t count) {
     return 0;
 }
 
+static struct ryzen_smu_data* kobj_to_data(struct kobject *kobj) {
+    u32 i;
+
+    if (kobj == g_driver.drv_kobj)
+        return g_driver.nodes[0];
+
+    for (i = 0; i < SMU_MAX_NODES; i++)
+        if (g_driver.nodes[i] && g_driver.nodes[i]->node_kobj == kobj)
+            return g_driver.nodes[i];
+
+    return NULL;
+}
+
 static ssize_t drv_version_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
     return sprintf(buff, "%s\n", THIS_MODULE->version);
 }
 
 static ssize_t version_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
-    return sprintf(buff, "%s\n", g_driver.smu_version);
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+
+    return sprintf(buff, "%s\n", data->smu_version);
 }
 
 static ssize_t mp1_if_version_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
@@ -97,36 +168,63 @@ static ssize_t codename_show(struct kobject *kobj, struct kobj_attribute *attr,
     return sprintf(buff, "%02d\n", smu_get_codename());
 }
 
-static ssize_t pm_table_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
-    if (smu_read_pm_table(g_driver.device, g_driver.pm_table, &g_driver.pm_table_read_size) != SMU_Return_OK)
+static ssize_t pm_table_read(struct file *filp, struct kobject *kobj,
+    __BIN_ATTR_CONST struct bin_attribute *attr, char *buff, loff_t off, size_t count) {
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+    size_t len = count;
+    u32 max_age_us;
+
+    // Tables larger than a page are read in several calls. Only the first one refreshes the table
+    //  so that the others continue the same table, unless another reader started over in between,
+    //  which can't be told apart as bin attributes have no state per open file.
+    max_age_us = off ? U32_MAX :
+        min_t(u32, READ_ONCE(pm_refresh_interval_us), PM_REFRESH_INTERVAL_MAX_US);
+
+    // Only the requested part of the table is copied, straight into the sysfs buffer.
+    if (smu_read_pm_table_range(data->device, (u8*)buff, off, &len, max_age_us) != SMU_Return_OK)
         return 0;
 
-    memcpy(buff, g_driver.pm_table, g_driver.pm_table_read_size);
-    return g_driver.pm_table_read_size;
+    return len;
+}
+
+void ryzen_smu_pm_table_notify(u32 node) {
+    struct ryzen_smu_data* data = node < SMU_MAX_NODES ? g_driver.nodes[node] : NULL;
+
+    if (!data || !data->node_kobj)
+        return;
+
+    sysfs_notify(data->node_kobj, NULL, "pm_table");
+
+    if (node == 0)
+        sysfs_notify(g_driver.drv_kobj, NULL, "pm_table");
 }
 
 static ssize_t pm_table_version_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
-    ssize_t sz = sizeof(g_driver.pm_table_version);
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+    ssize_t sz = sizeof(data->pm_table_version);
 
-    memcpy(buff, &g_driver.pm_table_version, sz);
+    memcpy(buff, &data->pm_table_version, sz);
     return sz;
 }
 
 static ssize_t pm_table_size_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
-    ssize_t sz = sizeof(g_driver.pm_table_read_size);
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+    ssize_t sz = sizeof(data->pm_table_read_size);
 
-    memcpy(buff, &g_driver.pm_table_read_size, sz);
+    memcpy(buff, &data->pm_table_read_size, sz);
     return sz;
 }
 
 static ssize_t rsmu_cmd_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
-    ssize_t sz = sizeof(g_driver.smu_rsp);
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+    ssize_t sz = sizeof(data->smu_rsp);
 
-    memcpy(buff, &g_driver.smu_rsp, sz);
+    memcpy(buff, &data->smu_rsp, sz);
     return sz;
 }
 
 static ssize_t rsmu_cmd_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buff, size_t count) {
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
     u32 op;
 
     // To date, there has never been a command that actually exceeds FFh
@@ -142,18 +240,20 @@ static ssize_t rsmu_cmd_store(struct kobject *kobj, struct kobj_attribute *attr,
             return 0;
     }
 
-    g_driver.smu_rsp = smu_send_command(g_driver.device, op, &g_driver.smu_args, MAILBOX_TYPE_RSMU);
+    data->smu_rsp = smu_send_command(data->device, op, &data->smu_args, MAILBOX_TYPE_RSMU);
     return count;
 }
 
 static ssize_t mp1_smu_cmd_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
-    ssize_t sz = sizeof(g_driver.smu_rsp);
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+    ssize_t sz = sizeof(data->smu_rsp);
 
-    memcpy(buff, &g_driver.smu_rsp, sz);
+    memcpy(buff, &data->smu_rsp, sz);
     return sz;
 }
 
 static ssize_t mp1_smu_cmd_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buff, size_t count) {
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
     u32 op;
 
     // To date, there has never been a command that actually exceeds FFh
@@ -169,34 +269,39 @@ static ssize_t mp1_smu_cmd_store(struct kobject *kobj, struct kobj_attribute *at
             return 0;
     }
 
-    g_driver.smu_rsp = smu_send_command(g_driver.device, op, &g_driver.smu_args, MAILBOX_TYPE_MP1);
+    data->smu_rsp = smu_send_command(data->device, op, &data->smu_args, MAILBOX_TYPE_MP1);
     return count;
 }
 
 static ssize_t smu_args_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
-    ssize_t sz = sizeof(g_driver.smu_args);
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+    ssize_t sz = sizeof(data->smu_args);
 
-    memcpy(buff, &g_driver.smu_args.args, sz);
+    memcpy(buff, &data->smu_args.args, sz);
     return sz;
 }
 
 static ssize_t smu_args_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buff, size_t count) {
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+
     if (count != sizeof(u32) * 6)
         return 0;
 
-    memcpy(g_driver.smu_args.args, buff, count);
+    memcpy(data->smu_args.args, buff, count);
     return count;
 }
 
 static ssize_t smn_show(struct kobject *kobj, struct kobj_attribute *attr, char *buff) {
-    ssize_t sz = sizeof(g_driver.smn_result);
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+    ssize_t sz = sizeof(data->smn_result);
 
-    memcpy(buff, &g_driver.smn_result, sz);
+    memcpy(buff, &data->smn_result, sz);
     return sz;
 }
 
 static ssize_t smn_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buff,
 size_t count) {
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
     u32 address, value;
 
     switch (count) {
@@ -204,7 +309,7 @@ size_t count) {
             // One word written means we read this address at buff[0]
             address = *(u32*)buff;
 
-            if (smu_read_address(g_driver.device, address, &g_driver.smn_result) != SMU_Return_OK)
+            if (smu_read_address(data->device, address, &data->smn_result) != SMU_Return_OK)
                 pr_debug("Failed to read SMN address 0x%x\n", address);
             break;
         case (sizeof(u32) * 2):
@@ -212,12 +317,12 @@ size_t count) {
             address = *(u32*)buff;
             value = *(u32*)(buff + sizeof(u32));
 
-            if (smu_write_address(g_driver.device, address, value) != SMU_Return_OK) {
+            if (smu_write_address(data->device, address, value) != SMU_Return_OK) {
                 pr_debug("Failed to write SMN address 0x%x with value 0x%x\n", address, value);
-                g_driver.smn_result = SMU_Return_PCIFailed;
+                data->smn_result = SMU_Return_PCIFailed;
             }
             else
-                g_driver.smn_result = SMU_Return_OK;
+                data->smn_result = SMU_Return_OK;
             break;
         default:
             return 0;
@@ -231,7 +336,7 @@ __RO_ATTR (version);
 __RO_ATTR (mp1_if_version);
 __RO_ATTR (codename);
 
-__RO_ATTR (pm_table);
+__RO_BIN_ATTR (pm_table);
 __RO_ATTR (pm_table_size);
 __RO_ATTR (pm_table_version);
 
@@ -241,7 +346,7 @@ __RW_ATTR (smu_args);
 
 __RW_ATTR (smn);
 
-static struct attribute *drv_attrs[MAX_ATTRS_LEN] = {
+static struct attribute *drv_attrs[] = {
     &dev_attr_drv_version.attr,
     &dev_attr_version.attr,
     &dev_attr_mp1_if_version.attr,
@@ -252,28 +357,42 @@ static struct attribute *drv_attrs[MAX_ATTRS_LEN] = {
 
     &dev_attr_smn.attr,
 
-    // -- NOTE: Do not edit below here. --
-
-    // RSMU Optional Pointer
-    NULL,
+    // Optional, see drv_attr_is_visible().
+    &dev_attr_rsmu_cmd.attr,
 
-    // PM Table Optional Pointers
-    NULL,
-    NULL,
-    NULL,
+    &dev_attr_pm_table_size.attr,
+    &dev_attr_pm_table_version.attr,
 
-    // Termination Pointer
     NULL,
 };
 
+static umode_t drv_attr_is_visible(struct kobject *kobj, struct attribute *attr, int n) {
+    struct ryzen_smu_data* data = kobj_to_data(kobj);
+
+    if (!data)
+        return 0;
+
+    if (attr == &dev_attr_rsmu_cmd.attr)
+        return data->rsmu_supported ? attr->mode : 0;
+
+    if (attr == &dev_attr_pm_table_size.attr)
+        return data->pm_table_supported ? attr->mode : 0;
+
+    if (attr == &dev_attr_pm_table_version.attr)
+        return data->pm_table_supported && data->pm_table_version ? attr->mode : 0;
+
+    return attr->mode;
+}
+
 static struct attribute_group drv_attr_group = {
-    .attrs = drv_attrs,
+    .attrs      = drv_attrs,
+    .is_visible = drv_attr_is_visible,
 };
 
-static int ryzen_smu_get_version(enum smu_mailbox mb, int show) {
+static int ryzen_smu_get_version(struct ryzen_smu_data* data, enum smu_mailbox mb, int show) {
     u32 ver;
 
-    ver = smu_get_version(g_driver.device, mb);
+    ver = smu_get_version(data->device, mb);
     if (ver >= 0 && ver <= 0xFF) {
         pr_err("Failed to query the %sSMU version: %d",
             mb == MAILBOX_TYPE_RSMU ? "R" : "MP1 ", ver);
@@ -283,82 +402,96 @@ static int ryzen_smu_get_version(enum smu_mailbox mb, int show) {
     // In case this just tests for mailbox functionality, we don't need to output anything.
     if (show) {
         if (ver & 0xFF000000)
-            sprintf(g_driver.smu_version, "%d.%d.%d.%d",
+            sprintf(data->smu_version, "%d.%d.%d.%d",
                 (ver >> 24) & 0xff, (ver >> 16) & 0xff, (ver >> 8) & 0xff, ver & 0xff);
         else
-            sprintf(g_driver.smu_version, "%d.%d.%d", (ver >> 16) & 0xff, (ver >> 8) & 0xff, ver & 0xff);
+            sprintf(data->smu_version, "%d.%d.%d", (ver >> 16) & 0xff, (ver >> 8) & 0xff, ver & 0xff);
 
-        pr_info("SMU v%s", g_driver.smu_version);
+        pr_info("SMU v%s (node %d, %s)", data->smu_version, data->node, pci_name(data->device));
     }
 
     return 0;
 }
 
-static int ryzen_smu_probe(struct pci_dev *dev, const struct pci_device_id *id) {
-    enum smu_return_val ret;
+/**
+ * Exposes the fields of the PM table individually, through hwmon and as perf events when its
+ *  layout is known. Optional, like the character devices, as the raw table remains available.
+ */
+static void ryzen_smu_register_pm_fields(struct ryzen_smu_data* data) {
+    const struct pm_schema* schema;
+
+    schema = pm_schema_find(smu_get_codename(), data->pm_table_version);
+    if (!schema)
+        return;
+
+    // Quietly absent when the kernel lacks hwmon or perf support.
+    data->pm_hwmon = pm_hwmon_register(data->device, data->node, schema);
+    data->pm_perf = pm_perf_register(data->node, schema);
+
+    data->pm_fields = pm_fields_create(data->node_kobj, data->node, schema);
+    if (!data->pm_fields) {
+        pr_err("Unable to create the pm_fields sysfs interface for node %d", data->node);
+        return;
+    }
 
-    g_driver.device = dev;
+    if (data->node == 0 && sysfs_create_link(g_driver.drv_kobj, pm_fields_kobj(data->pm_fields), "pm_fields"))
+        pr_err("Unable to create the pm_fields sysfs link");
+}
 
-    // Clamp values.
-    if (smu_timeout_attempts > SMU_RETRIES_MAX)
-        smu_timeout_attempts = SMU_RETRIES_MAX;
-    if (smu_timeout_attempts < SMU_RETRIES_MIN)
-        smu_timeout_attempts = SMU_RETRIES_MIN;
+static void ryzen_smu_unregister_pm_fields(struct ryzen_smu_data* data) {
+    pm_perf_unregister(data->pm_perf);
+    pm_hwmon_unregister(data->pm_hwmon);
 
-    // Detect processor class & figure out MP1/RSMU support.
-    if (smu_init(g_driver.device) != 0) {
-        pr_err("Failed to initialize the SMU for use");
-        return -ENODEV;
-    }
+    if (data->pm_fields) {
+        if (data->node == 0)
+            sysfs_remove_link(g_driver.drv_kobj, "pm_fields");
 
-    // Check if MP1 is working as we guarantee this support.
-    if (ryzen_smu_get_version(MAILBOX_TYPE_MP1, 1) != 0) {
-        pr_err("Failed to obtain the SMU version");
-        return -EINVAL;
+        pm_fields_destroy(data->pm_fields);
     }
+}
+
+/**
+ * Checks for the RSMU mailbox and whether the PM table can be read through it, determining the
+ *  size of the pm_table attribute when it can.
+ */
+static void ryzen_smu_probe_pm_table(struct ryzen_smu_data* data) {
+    struct pci_dev* dev = data->device;
+    enum smu_return_val ret;
+    u8* table;
 
     // Check if RSMU is valid to determine if to skip PM table setup.
-    if (ryzen_smu_get_version(MAILBOX_TYPE_RSMU, 0) == 0) {
-        // We do something absolutely stupid here and use relative offsets to overwrite offsets
-        //  in the drv_attrs[] array.
-        //
-        // This shouldn't *typically* cause errors unless the array structure is messed with.
-        // So, we left a warning above to not touch it.
-        drv_attrs[MAX_ATTRS_LEN - 5] = &dev_attr_rsmu_cmd.attr;
-    }
+    if (ryzen_smu_get_version(data, MAILBOX_TYPE_RSMU, 0) == 0)
+        data->rsmu_supported = true;
     else {
         pr_info("RSMU Mailbox: Disabled or not responding to commands.");
-        goto _CONTINUE_SETUP;
+        return;
     }
 
-    // Check that PM table options are supported before adding it to the attr list
-    ret = smu_transfer_table_to_dram(g_driver.device);
+    // Check that PM table options are supported before exposing them.
+    ret = smu_transfer_table_to_dram(dev);
     if (ret == SMU_Return_OK) {
-        ret = smu_get_pm_table_version(g_driver.device, &g_driver.pm_table_version);
+        ret = smu_get_pm_table_version(dev, &data->pm_table_version);
         if (ret != SMU_Return_OK && ret != SMU_Return_Unsupported) {
             pr_err("Unable to resolve which PM table version the system uses -- disabling "
                 "feature (%d)", ret);
-            goto _CONTINUE_SETUP;
+            return;
         }
 
-        g_driver.pm_table = kzalloc(PM_TABLE_MAX_SIZE, GFP_KERNEL);
-        if (g_driver.pm_table == NULL) {
+        table = kmalloc(PM_TABLE_MAX_SIZE, GFP_KERNEL);
+        if (table == NULL) {
             pr_err("Unable to allocate kernel buffer for PM table mapping -- disabling PM table "
                 "feature");
-            goto _CONTINUE_SETUP;
+            return;
         }
 
-        // Perform an initial fill of the data for when the device is queued, saving time
+        // Perform an initial read, mapping the table and determining its size.
         pr_debug("Probing the PM table for state changes");
-        ret = smu_read_pm_table(dev, g_driver.pm_table, &g_driver.pm_table_read_size);
-        if (ret == SMU_Return_OK) {
-            pr_debug("Probe succeeded: read %ld bytes", g_driver.pm_table_read_size);
+        ret = smu_read_pm_table(dev, table, &data->pm_table_read_size);
+        kfree(table);
 
-            drv_attrs[MAX_ATTRS_LEN - 4] = &dev_attr_pm_table_size.attr;
-            drv_attrs[MAX_ATTRS_LEN - 3] = &dev_attr_pm_table.attr;
-
-            if (g_driver.pm_table_version)
-                drv_attrs[MAX_ATTRS_LEN - 2] = &dev_attr_pm_table_version.attr;
+        if (ret == SMU_Return_OK) {
+            pr_debug("Probe succeeded: read %ld bytes", data->pm_table_read_size);
+            data->pm_table_supported = true;
         }
         else
             pr_err("Failed to probe the PM table -- disabling feature (%d)", ret);
@@ -366,30 +499,224 @@ static int ryzen_smu_probe(struct pci_dev *dev, const struct pci_device_id *id)
     else {
         pr_debug("Notice: PM tables are not supported for the current platform (%d)", ret);
     }
+}
+
+/**
+ * Completes the setup of a node once probed: discovers the PM table, creates everything relying on
+ *  it and reveals the attributes which were hidden until then.
+ */
+static void ryzen_smu_init_work(struct work_struct* work) {
+    struct ryzen_smu_data* data = container_of(work, struct ryzen_smu_data, init_work);
+    struct pci_dev* dev = data->device;
+    u32 node = data->node;
+
+    ryzen_smu_probe_pm_table(data);
+
+    // The table is the same size on every node of a system.
+    if (data->pm_table_supported) {
+        dev_attr_pm_table.size = data->pm_table_read_size;
+
+        if (sysfs_create_bin_file(data->node_kobj, &dev_attr_pm_table) ||
+            (node == 0 && sysfs_create_bin_file(g_driver.drv_kobj, &dev_attr_pm_table)))
+            pr_err("Unable to create the pm_table sysfs file");
+    }
+
+    if (data->pm_table_supported && smu_pm_dev_register(dev, node, data->pm_table_version))
+        pr_err("Unable to create the PM table snapshot device");
+    else if (data->pm_table_supported)
+        ryzen_smu_register_pm_fields(data);
+
+    if (data->pm_table_supported && smu_pm_table_dev_register(dev, node))
+        pr_err("Unable to create the PM table access device");
+
+    // Attributes of the RSMU mailbox and the PM table were hidden until now.
+    if (sysfs_update_group(data->node_kobj, &drv_attr_group) ||
+        (node == 0 && sysfs_update_group(g_driver.drv_kobj, &drv_attr_group)))
+        pr_err("Unable to update the sysfs interface for node %d", node);
+
+    pr_info("Node %d ready in %lld us", node, ktime_us_delta(ktime_get(), data->probe_start));
+}
+
+/**
+ * Resolves the node number of the root complex [dev].
+ *
+ * Processors with several root complexes per SMU (Threadripper, EPYC) expose all of them with the
+ *  same device ID. Like amd_nb, the roots are split evenly among the data fabric nodes, found at
+ *  00:18.3 onwards, and only the first root of each node is bound since all of them lead to the
+ *  same SMU.
+ *
+ * Returns the node number or -ENODEV if [dev] isn't the first root complex of its node.
+ */
+static int ryzen_smu_resolve_node(struct pci_dev *dev) {
+    int nodes, roots = 0, index = -1, roots_per_node;
+    struct pci_dev *df, *root = NULL;
+    bool is_amd;
+
+    for (nodes = 0; nodes < SMU_MAX_NODES; nodes++) {
+        df = pci_get_domain_bus_and_slot(0, 0, PCI_DEVFN(0x18 + nodes, 3));
+        if (!df)
+            break;
+
+        is_amd = df->vendor == PCI_VENDOR_ID_AMD;
+        pci_dev_put(df);
+
+        if (!is_amd)
+            break;
+    }
+
+    // Root complexes are enumerated in bus order, matching the order of the nodes.
+    while ((root = pci_get_device(dev->vendor, dev->device, root)) != NULL) {
+        if (root == dev)
+            index = roots;
+
+        roots++;
+    }
+
+    if (index < 0)
+        return -ENODEV;
+
+    // Without a recognizable topology, only bind the first root complex.
+    if (!nodes || roots % nodes)
+        return index ? -ENODEV : 0;
+
+    roots_per_node = roots / nodes;
+
+    return index % roots_per_node ? -ENODEV : index / roots_per_node;
+}
+
+static int ryzen_smu_probe(struct pci_dev *dev, const struct pci_device_id *id) {
+    struct ryzen_smu_data* data;
+    char node_name[16];
+    int node, err;
+
+    node = ryzen_smu_resolve_node(dev);
+    if (node < 0) {
+        pr_debug("Skipping %s as its SMU is bound through another root complex", pci_name(dev));
+        return -ENODEV;
+    }
+
+    if (node >= SMU_MAX_NODES || g_driver.nodes[node]) {
+        pr_err("Node %d of %s is already bound", node, pci_name(dev));
+        return -EBUSY;
+    }
+
+    data = kzalloc(sizeof(*data), GFP_KERNEL);
+    if (!data)
+        return -ENOMEM;
+
+    data->device = dev;
+    data->node = node;
+    data->probe_start = ktime_get();
+    data->smu_rsp = SMU_Return_OK;
+    data->pm_table_read_size = PM_TABLE_MAX_SIZE;
+
+    // Clamp values.
+    if (smu_timeout_us > SMU_TIMEOUT_MAX_US)
+        smu_timeout_us = SMU_TIMEOUT_MAX_US;
+    if (smu_timeout_us < SMU_TIMEOUT_MIN_US)
+        smu_timeout_us = SMU_TIMEOUT_MIN_US;
+    if (smn_lanes > SMU_SMN_LANES_MAX)
+        smn_lanes = SMU_SMN_LANES_MAX;
+    if (smn_lanes < 1)
+        smn_lanes = 1;
+
+    // Detect processor class & figure out MP1/RSMU support.
+    if (smu_init(dev) != 0) {
+        pr_err("Failed to initialize the SMU for use");
+        err = -ENODEV;
+        goto FREE_DATA;
+    }
+
+    // Check if MP1 is working as we guarantee this support.
+    if (ryzen_smu_get_version(data, MAILBOX_TYPE_MP1, 1) != 0) {
+        pr_err("Failed to obtain the SMU version");
+        err = -EINVAL;
+        goto CLEANUP_SMU;
+    }
+
+    // The node must be resolvable by the sysfs attributes before they are created.
+    g_driver.nodes[node] = data;
+    pci_set_drvdata(dev, data);
 
-_CONTINUE_SETUP:
     // Allocate the sysfs attr group with the parameters for use
-    g_driver.drv_kobj = kobject_create_and_add("ryzen_smu_drv", kernel_kobj);
-    if (!g_driver.drv_kobj) {
+    snprintf(node_name, sizeof(node_name), "node%d", node);
+
+    data->node_kobj = kobject_create_and_add(node_name, g_driver.drv_kobj);
+    if (!data->node_kobj) {
         pr_err("Unable to create sysfs interface");
-        return -ENOMEM;
+        err = -ENOMEM;
+        goto CLEAR_NODE;
     }
 
-    if (sysfs_create_group(g_driver.drv_kobj, &drv_attr_group))
-        kobject_put(g_driver.drv_kobj);
+    if (sysfs_create_group(data->node_kobj, &drv_attr_group))
+        pr_err("Unable to create sysfs interface for node %d", node);
+
+    // The first node is also exposed at the top level, where it always used to be.
+    if (node == 0 && sysfs_create_group(g_driver.drv_kobj, &drv_attr_group))
+        pr_err("Unable to create sysfs interface");
+
+    // Character devices are optional, the sysfs interface remains usable without them.
+    if (smu_dev_register(dev, node))
+        pr_err("Unable to create the SMU command device");
+
+    if (smn_dev_register(dev, node))
+        pr_err("Unable to create the SMN access device");
+
+    // Everything relying on the RSMU mailbox takes several commands to set up, so it is left out of
+    //  the way of the boot and the loading of the module.
+    INIT_WORK(&data->init_work, ryzen_smu_init_work);
+    queue_work(system_unbound_wq, &data->init_work);
 
     return 0;
+
+CLEAR_NODE:
+    pci_set_drvdata(dev, NULL);
+    g_driver.nodes[node] = NULL;
+
+CLEANUP_SMU:
+    smu_cleanup(dev);
+
+FREE_DATA:
+    kfree(data);
+
+    return err;
 }
 
 static void ryzen_smu_remove(struct pci_dev *dev) {
-    // Free allocated resources as well as the SMU
-    if (g_driver.pm_table)
-        kfree(g_driver.pm_table);
+    struct ryzen_smu_data* data = pci_get_drvdata(dev);
 
-    if (g_driver.drv_kobj)
-        kobject_put(g_driver.drv_kobj);
+    if (!data)
+        return;
+
+    // Nothing may be set up anymore while the node is torn down.
+    cancel_work_sync(&data->init_work);
+
+    // The fields read from the snapshot device so they go first.
+    ryzen_smu_unregister_pm_fields(data);
 
-    smu_cleanup();
+    // Wait for queued commands to complete before the SMU is torn down.
+    smu_dev_unregister(data->node);
+    smn_dev_unregister(data->node);
+    smu_pm_dev_unregister(data->node);
+    smu_pm_table_dev_unregister(data->node);
+
+    if (data->node == 0) {
+        if (data->pm_table_supported)
+            sysfs_remove_bin_file(g_driver.drv_kobj, &dev_attr_pm_table);
+
+        sysfs_remove_group(g_driver.drv_kobj, &drv_attr_group);
+    }
+
+    if (data->node_kobj)
+        kobject_put(data->node_kobj);
+
+    g_driver.nodes[data->node] = NULL;
+    pci_set_drvdata(dev, NULL);
+
+    // Free allocated resources as well as the SMU
+    smu_cleanup(dev);
+
+    kfree(data);
 }
 
 static struct pci_device_id ryzen_smu_id_table[] = {
@@ -409,10 +736,30 @@ static struct pci_driver ryzen_smu_driver = {
 };
 
 static int __init ryzen_smu_driver_init(void) {
+    // Statistics are optional, the driver is fully functional without them.
+    if (smu_stats_init())
+        pr_warn("Unable to allocate command statistics");
+
+    // Likewise for perf events, which are only lacking the PMUs without it.
+    if (pm_perf_init())
+        pr_warn("Unable to set up perf events");
+
+    // Every node is placed underneath the same directory.
+    g_driver.drv_kobj = kobject_create_and_add("ryzen_smu_drv", kernel_kobj);
+    if (!g_driver.drv_kobj) {
+        pr_err("Unable to create sysfs interface");
+        pm_perf_cleanup();
+        smu_stats_cleanup();
+        return -ENOMEM;
+    }
+
     // By default the driver will not be used to communicate with the
     //  northbridge so we forcefully tell the system to use it.
     if (pci_register_driver(&ryzen_smu_driver) < 0) {
         pr_err("Failed to register the PCI driver.");
+        kobject_put(g_driver.drv_kobj);
+        pm_perf_cleanup();
+        smu_stats_cleanup();
         return 1;
     }
 
@@ -421,10 +768,77 @@ static int __init ryzen_smu_driver_init(void) {
 
 static void ryzen_smu_driver_exit(void) {
     pci_unregister_driver(&ryzen_smu_driver);
+
+    kobject_put(g_driver.drv_kobj);
+
+    pm_perf_cleanup();
+    smu_stats_cleanup();
 }
 
 module_init(ryzen_smu_driver_init);
 module_exit(ryzen_smu_driver_exit);
 
-module_param(smu_timeout_attempts, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-MODULE_PARM_DESC(smu_timeout_attempts, "When executing an SMU command, the driver will retry this many times before considering a command to have timed out. Default: 8192");
+module_param(smu_timeout_us, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(smu_timeout_us, "When executing an SMU command, the driver will wait this many microseconds for a response before considering a command to have timed out. Default: 20000");
+
+// smu_timeout_attempts was replaced by smu_timeout_us, existing configurations are converted with
+//  the old default amount of attempts corresponding to the new default timeout.
+static int smu_timeout_attempts_set(const char* val, const struct kernel_param* kp) {
+    uint attempts;
+    int err;
+
+    err = kstrtouint(val, 0, &attempts);
+    if (err)
+        return err;
+
+    pr_warn("smu_timeout_attempts is deprecated, use smu_timeout_us instead");
+
+    WRITE_ONCE(smu_timeout_us, smu_timeout_attempts_to_us(attempts));
+
+    return 0;
+}
+
+static int smu_timeout_attempts_get(char* buff, const struct kernel_param* kp) {
+    return sprintf(buff, "%u\n", smu_timeout_us_to_attempts(READ_ONCE(smu_timeout_us)));
+}
+
+static const struct kernel_param_ops smu_timeout_attempts_ops = {
+    .set = smu_timeout_attempts_set,
+    .get = smu_timeout_attempts_get,
+};
+
+module_param_cb(smu_timeout_attempts, &smu_timeout_attempts_ops, NULL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(smu_timeout_attempts, "Deprecated, use smu_timeout_us. Converted to microseconds with 8192 attempts corresponding to 20000 us.");
+
+module_param(smn_lanes, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(smn_lanes, "Maximum number of PCI index/data register pairs concurrent SMN accesses are spread across, from 1 to 3. The third pair is shared with the kernel's own SMN accessors. Default: 2");
+
+module_param(smu_cache, bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(smu_cache, "Answer SMU getter commands whose results can't change, such as GetSMUVersion, from a cache instead of the mailbox. Default: true");
+
+static int pm_sample_interval_set(const char* val, const struct kernel_param* kp) {
+    int err = param_set_uint(val, kp);
+
+    // The samplers sleep while paused, wake them up to start sampling at the new interval.
+    if (!err)
+        smu_pm_dev_sampler_wake();
+
+    return err;
+}
+
+static const struct kernel_param_ops pm_sample_interval_ops = {
+    .set = pm_sample_interval_set,
+    .get = param_get_uint,
+};
+
+module_param_cb(pm_sample_interval_us, &pm_sample_interval_ops, &pm_sample_interval_us, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(pm_sample_interval_us, "When non-zero while the driver is loaded, the PM table is sampled in the kernel every this many microseconds, from 1000 to 10000000. May be changed at runtime, 0 pausing sampling. Default: 0");
+
+module_param(pm_history_len, uint, S_IRUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(pm_history_len, "Size of the history of /dev/ryzen_smu_pm in PM table samples, up to 262144, assuming an eighth of the table changes between samples. Fewer samples are held when more of it changes. Default: 0 (disabled)");
+
+module_param(pm_refresh_interval_us, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(pm_refresh_interval_us, "Readers of the PM table within this many microseconds of the last refresh receive the same table rather than having the SMU refresh it, up to 1000000. May be changed at runtime. Default: 1000");
+
+module_param(pm_copy_strategy, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(pm_copy_strategy, "How the PM table is copied out of DRAM: 0 for memcpy_fromio(), 1 for memcpy(), 2 for aligned 64 byte blocks. Compare them in /sys/kernel/debug/ryzen_smu/pm_copy_bench. May be changed at runtime. Default: 0");
@@ -16,12 +16,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
+/* SMN addresses are used as file offsets which may exceed the range of a 32 bit off_t. */
+#define _FILE_OFFSET_BITS               64
+
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
 
 #include "libsmu.h"
+#include "../ryzen_smu.h"
 
 #define DRIVER_CLASS_PATH               "/sys/kernel/ryzen_smu_drv/"
 
@@ -39,6 +45,12 @@
 #define PM_SIZE_PATH                    DRIVER_CLASS_PATH "pm_table_size"
 #define PM_PATH                         DRIVER_CLASS_PATH "pm_table"
 
+#define SMN_DEV_PATH                    "/dev/ryzen_smn"
+#define SMU_DEV_PATH                    "/dev/ryzen_smu"
+
+/* smu_smn_op_t is passed to the driver as-is. */
+_Static_assert(sizeof(smu_smn_op_t) == sizeof(struct ryzen_smn_op), "smu_smn_op_t must match struct ryzen_smn_op");
+
 /* Maximum driver version length defined as "255.255.255\n" */
 #define LIBSMU_MAX_DRIVER_VERSION_LEN   12
 
@@ -184,6 +196,10 @@ smu_return_val smu_init(smu_obj_t* obj) {
         !try_open_path(SMU_ARG_PATH, O_RDWR, &obj->fd_smu_args))
         return SMU_Return_RWError;
 
+    // Devices are only available in newer drivers, the sysfs files are used when they're absent.
+    try_open_path(SMN_DEV_PATH, O_RDWR, &obj->fd_smn_dev);
+    try_open_path(SMU_DEV_PATH, O_RDWR, &obj->fd_smu_dev);
+
     // RSMU is optionally supported for some codenames.
     if (try_open_path(RSMU_CMD_PATH, O_RDWR, &obj->fd_rsmu_cmd)) {
         // This file may optionally exist only if PM tables are supported AND RSMU as well.
@@ -221,6 +237,12 @@ void smu_free(smu_obj_t* obj) {
     if (obj->fd_pm_table)
         close(obj->fd_pm_table);
 
+    if (obj->fd_smn_dev)
+        close(obj->fd_smn_dev);
+
+    if (obj->fd_smu_dev)
+        close(obj->fd_smu_dev);
+
     for (i = 0; i < SMU_MUTEX_COUNT; i++)
         pthread_mutex_destroy(&obj->lock[i]);
 
@@ -254,6 +276,11 @@ smu_return_val smu_read_smn_addr(smu_obj_t* obj, unsigned int address, unsigned
     if (!obj->init)
         return SMU_Return_Failed;
 
+    // The SMN device is addressed directly and keeps no state, so no locking is needed.
+    if (obj->fd_smn_dev)
+        return pread(obj->fd_smn_dev, result, sizeof(*result), address) == sizeof(*result) ?
+            SMU_Return_OK : SMU_Return_RWError;
+
     pthread_mutex_lock(&obj->lock[SMU_MUTEX_SMN]);
 
     lseek(obj->fd_smn, 0, SEEK_SET);
@@ -278,6 +305,10 @@ smu_return_val smu_write_smn_addr(smu_obj_t* obj, unsigned int address, unsigned
     if (!obj->init)
         return SMU_Return_Failed;
 
+    if (obj->fd_smn_dev)
+        return pwrite(obj->fd_smn_dev, &value, sizeof(value), address) == sizeof(value) ?
+            SMU_Return_OK : SMU_Return_RWError;
+
     // buffer[0] contains the destination write target.
     // buffer[1] contains the value to write to the address.
     buffer[0] = address;
@@ -293,6 +324,97 @@ smu_return_val smu_write_smn_addr(smu_obj_t* obj, unsigned int address, unsigned
     return ret == sizeof(buffer) ? SMU_Return_OK : SMU_Return_RWError;
 }
 
+smu_return_val smu_read_smn_range(smu_obj_t* obj, unsigned int address, unsigned int* dst,
+    unsigned int count) {
+    smu_return_val ret;
+    size_t len;
+    unsigned int i;
+
+    // Don't attempt to execute without initialization.
+    if (!obj->init)
+        return SMU_Return_Failed;
+
+    if (!obj->fd_smn_dev) {
+        for (i = 0; i < count; i++) {
+            ret = smu_read_smn_addr(obj, address + (i * 4), &dst[i]);
+            if (ret != SMU_Return_OK)
+                return ret;
+        }
+
+        return SMU_Return_OK;
+    }
+
+    len = (size_t)count * sizeof(*dst);
+
+    return pread(obj->fd_smn_dev, dst, len, address) == (ssize_t)len ?
+        SMU_Return_OK : SMU_Return_RWError;
+}
+
+smu_return_val smu_rw_smn_batch(smu_obj_t* obj, smu_smn_op_t* ops, unsigned int count) {
+    unsigned int i, j, n;
+    struct ryzen_smn_batch batch;
+    smu_return_val ret;
+
+    // Don't attempt to execute without initialization.
+    if (!obj->init)
+        return SMU_Return_Failed;
+
+    ret = SMU_Return_OK;
+
+    // Without the SMN device, fall back to performing each access individually.
+    if (!obj->fd_smn_dev) {
+        for (i = 0; i < count; i++) {
+            ops[i].status = ops[i].write ?
+                smu_write_smn_addr(obj, ops[i].address, ops[i].value) :
+                smu_read_smn_addr(obj, ops[i].address, &ops[i].value);
+
+            if (ops[i].status != SMU_Return_OK)
+                ret = ops[i].status;
+        }
+
+        return ret;
+    }
+
+    // smu_smn_op_t shares its layout with the driver's structure so it can be passed as-is.
+    for (i = 0; i < count; i += n) {
+        n = count - i < RYZEN_SMN_BATCH_MAX ? count - i : RYZEN_SMN_BATCH_MAX;
+
+        batch.ops = (uintptr_t)(ops + i);
+        batch.count = n;
+        batch.reserved = 0;
+
+        if (ioctl(obj->fd_smn_dev, RYZEN_SMN_IOC_BATCH, &batch) < 0)
+            return SMU_Return_RWError;
+
+        for (j = i; j < i + n; j++)
+            if (ops[j].status != SMU_Return_OK)
+                ret = ops[j].status;
+    }
+
+    return ret;
+}
+
+static smu_return_val smu_send_command_dev(smu_obj_t* obj, unsigned int op, smu_arg_t* args,
+    enum smu_mailbox mailbox) {
+    struct ryzen_smu_request req;
+
+    memset(&req, 0, sizeof(req));
+
+    // The driver numbers the mailboxes in the same order.
+    req.mailbox = mailbox;
+    req.op = op;
+    memcpy(req.args, args->args, sizeof(req.args));
+
+    if (ioctl(obj->fd_smu_dev, RYZEN_SMU_IOC_COMMAND, &req) < 0)
+        return SMU_Return_RWError;
+
+    // Arguments are only replaced upon success, as with the sysfs files.
+    if (req.status == SMU_Return_OK)
+        memcpy(args->args, req.args, sizeof(req.args));
+
+    return req.status;
+}
+
 smu_return_val smu_send_command(smu_obj_t* obj, unsigned int op, smu_arg_t* args,
     enum smu_mailbox mailbox) {
     unsigned int ret, status, fd_smu_cmd;
@@ -316,6 +438,11 @@ smu_return_val smu_send_command(smu_obj_t* obj, unsigned int op, smu_arg_t* args
     if (!fd_smu_cmd)
         return SMU_Return_Unsupported;
 
+    // The device executes the whole command in a single call and keeps no shared state, so it
+    //  needs no locking unlike the sysfs files.
+    if (obj->fd_smu_dev)
+        return smu_send_command_dev(obj, op, args, mailbox);
+
     pthread_mutex_lock(&obj->lock[SMU_MUTEX_CMD]);
 
     lseek(obj->fd_smu_args, 0, SEEK_SET);
@@ -359,6 +486,7 @@ BREAK_OUT:
 }
 
 smu_return_val smu_read_pm_table(smu_obj_t* obj, unsigned char* dst, size_t dst_len) {
+    size_t done = 0;
     int ret;
 
     // Don't attempt to execute without initialization.
@@ -370,10 +498,14 @@ smu_return_val smu_read_pm_table(smu_obj_t* obj, unsigned char* dst, size_t dst_
 
     pthread_mutex_lock(&obj->lock[SMU_MUTEX_PM]);
 
-    lseek(obj->fd_pm_table, 0, SEEK_SET);
-    ret = read(obj->fd_pm_table, dst, obj->pm_table_size);
+    // Tables larger than a page are returned over several reads.
+    do {
+        ret = pread(obj->fd_pm_table, dst + done, obj->pm_table_size - done, done);
+        if (ret > 0)
+            done += ret;
+    } while (ret > 0 && done < obj->pm_table_size);
 
-    if (ret != obj->pm_table_size)
+    if (done != obj->pm_table_size)
         ret = SMU_Return_RWError;
     else
         ret = SMU_Return_OK;
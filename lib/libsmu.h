@@ -134,10 +134,25 @@ typedef struct {
     int                         fd_mp1_smu_cmd;
     int                         fd_smu_args;
     int                         fd_pm_table;
+    int                         fd_smn_dev;
+    int                         fd_smu_dev;
 
     pthread_mutex_t             lock[SMU_MUTEX_COUNT];
 } smu_obj_t;
 
+/**
+ * Single SMN read or write performed as part of a batch.
+ */
+typedef struct {
+    unsigned int                address;
+    /* Value to write or, for reads, the value read. */
+    unsigned int                value;
+    /* Non-zero for writes, zero for reads. */
+    unsigned int                write;
+    /* Result of the access. */
+    smu_return_val              status;
+} smu_smn_op_t;
+
 typedef union {
     struct {
         float                   args0_f;
@@ -185,6 +200,22 @@ const char* smu_get_fw_version(smu_obj_t* obj);
 smu_return_val smu_read_smn_addr(smu_obj_t* obj, unsigned int address, unsigned int* result);
 smu_return_val smu_write_smn_addr(smu_obj_t* obj, unsigned int address, unsigned int value);
 
+/**
+ * Reads [count] consecutive 32 bit words from the SMN address space, starting at [address].
+ * When supported by the driver, this requires a single system call.
+ */
+smu_return_val smu_read_smn_range(smu_obj_t* obj, unsigned int address, unsigned int* dst,
+    unsigned int count);
+
+/**
+ * Performs [count] SMN reads or writes in order. When supported by the driver, the accesses are
+ *  executed in a single system call under a single lock acquisition.
+ * The result of each access is stored in its status and, for reads, value fields.
+ *
+ * Returns SMU_Return_OK if all accesses succeeded, otherwise the last error encountered.
+ */
+smu_return_val smu_rw_smn_batch(smu_obj_t* obj, smu_smn_op_t* ops, unsigned int count);
+
 /**
  * Sends a command to the SMU.
  * Arguments are sent in the args buffer and are also returned in it.
@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Delta Compression */
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/bitops.h>
+
+#define pm_delta_ctz(x)  __ffs(x)
+#else
+#include <string.h>
+
+#define pm_delta_ctz(x)  __builtin_ctz(x)
+#endif
+
+#include "pm_delta.h"
+
+// Records are made of 32-bit words, starting with the timestamp split in two.
+//  Keyframe: timestamp, table
+//  Delta:    timestamp, amount of changed words, bitmap of changed words, changed words
+#define PM_DELTA_KEYFRAME_HDR_WORDS   2
+#define PM_DELTA_DELTA_HDR_WORDS      3
+
+static u32 pm_delta_seg_size(u32 words) {
+    u32 bitmap_words = (words + 31) / 32;
+    u32 keyframe = PM_DELTA_KEYFRAME_HDR_WORDS + words;
+    u32 delta = PM_DELTA_DELTA_HDR_WORDS + bitmap_words + words / PM_DELTA_BUDGET_RATIO;
+
+    return (keyframe + (PM_DELTA_KEYFRAME_INTERVAL - 1) * delta) * sizeof(u32);
+}
+
+size_t pm_delta_mem_size(u32 size, u32 count) {
+    u32 words = size / sizeof(u32);
+    size_t seg_count;
+
+    if (!words || size % sizeof(u32))
+        return 0;
+
+    // An extra segment keeps [count] tables around while the oldest segment is being replaced.
+    seg_count = (count + PM_DELTA_KEYFRAME_INTERVAL - 1) / PM_DELTA_KEYFRAME_INTERVAL + 1;
+
+    return seg_count * (sizeof(struct pm_delta_segment) + pm_delta_seg_size(words)) +
+        words * sizeof(u32);
+}
+
+int pm_delta_init(struct pm_delta_history* hist, void* mem, size_t mem_size, u32 size) {
+    u32 words = size / sizeof(u32);
+    size_t seg_count;
+
+    if (!words || size % sizeof(u32))
+        return -1;
+
+    memset(hist, 0, sizeof(*hist));
+
+    hist->words = words;
+    hist->bitmap_words = (words + 31) / 32;
+    hist->seg_size = pm_delta_seg_size(words);
+
+    if (mem_size < words * sizeof(u32))
+        return -1;
+
+    seg_count = (mem_size - words * sizeof(u32)) /
+        (sizeof(struct pm_delta_segment) + hist->seg_size);
+
+    // Appending to a full ring always needs a segment to overwrite besides the current one.
+    if (seg_count < 2 || seg_count > (u32)-1)
+        return -1;
+
+    hist->seg_count = seg_count;
+
+    hist->segs = mem;
+    hist->prev = (u32*)(hist->segs + seg_count);
+    hist->data = (u8*)(hist->prev + words);
+
+    memset(hist->segs, 0, seg_count * sizeof(struct pm_delta_segment));
+
+    return 0;
+}
+
+static u32* pm_delta_seg_data(const struct pm_delta_history* hist, u32 seg) {
+    return (u32*)(hist->data + (size_t)seg * hist->seg_size);
+}
+
+static int pm_delta_append_delta(struct pm_delta_history* hist, struct pm_delta_segment* seg,
+    const u32* table, u64 timestamp) {
+    u32 *rec, *bitmap, *values;
+    u32 i, changed = 0;
+
+    for (i = 0; i < hist->words; i++)
+        changed += table[i] != hist->prev[i];
+
+    if (seg->used + (PM_DELTA_DELTA_HDR_WORDS + hist->bitmap_words + changed) * sizeof(u32) >
+        hist->seg_size)
+        return 0;
+
+    rec = pm_delta_seg_data(hist, hist->seg_head) + seg->used / sizeof(u32);
+    bitmap = rec + PM_DELTA_DELTA_HDR_WORDS;
+    values = bitmap + hist->bitmap_words;
+
+    rec[0] = (u32)timestamp;
+    rec[1] = (u32)(timestamp >> 32);
+    rec[2] = changed;
+
+    memset(bitmap, 0, hist->bitmap_words * sizeof(u32));
+
+    for (i = 0; i < hist->words; i++) {
+        if (table[i] != hist->prev[i]) {
+            bitmap[i / 32] |= 1U << (i % 32);
+            *values++ = table[i];
+        }
+    }
+
+    seg->used += (PM_DELTA_DELTA_HDR_WORDS + hist->bitmap_words + changed) * sizeof(u32);
+
+    return 1;
+}
+
+u64 pm_delta_append(struct pm_delta_history* hist, const void* table, u64 timestamp) {
+    struct pm_delta_segment* seg = &hist->segs[hist->seg_head];
+    u32* rec;
+
+    if (seg->count && seg->count < PM_DELTA_KEYFRAME_INTERVAL &&
+        pm_delta_append_delta(hist, seg, table, timestamp))
+        goto BREAK_OUT;
+
+    // Start a new segment with a keyframe, overwriting the oldest one.
+    if (seg->count) {
+        hist->seg_head = (hist->seg_head + 1) % hist->seg_count;
+        seg = &hist->segs[hist->seg_head];
+    }
+
+    seg->first_seq = hist->next_seq;
+    seg->count = 0;
+    seg->used = (PM_DELTA_KEYFRAME_HDR_WORDS + hist->words) * sizeof(u32);
+
+    rec = pm_delta_seg_data(hist, hist->seg_head);
+
+    rec[0] = (u32)timestamp;
+    rec[1] = (u32)(timestamp >> 32);
+
+    memcpy(rec + PM_DELTA_KEYFRAME_HDR_WORDS, table, hist->words * sizeof(u32));
+
+BREAK_OUT:
+    memcpy(hist->prev, table, hist->words * sizeof(u32));
+    seg->count++;
+
+    return hist->next_seq++;
+}
+
+u64 pm_delta_oldest(const struct pm_delta_history* hist) {
+    u32 i, seg;
+
+    // The segment after the current one is the oldest, unless the ring was not yet filled.
+    for (i = 1; i <= hist->seg_count; i++) {
+        seg = (hist->seg_head + i) % hist->seg_count;
+
+        if (hist->segs[seg].count)
+            return hist->segs[seg].first_seq;
+    }
+
+    return hist->next_seq;
+}
+
+u64 pm_delta_seek(const struct pm_delta_history* hist, struct pm_delta_cursor* cur, u64 seq) {
+    const struct pm_delta_segment* seg = &hist->segs[hist->seg_head];
+    u64 oldest = pm_delta_oldest(hist);
+    u32 i;
+
+    seq = seq > oldest ? seq : oldest;
+
+    cur->bitmap = NULL;
+    cur->values = NULL;
+    cur->changed = 0;
+
+    if (seq >= hist->next_seq) {
+        cur->seq = hist->next_seq;
+        cur->seg = hist->seg_head;
+        cur->offset = hist->segs[hist->seg_head].used;
+
+        return cur->seq;
+    }
+
+    // Newer tables are usually wanted, so search from the current segment backwards.
+    for (i = 0; i < hist->seg_count; i++) {
+        cur->seg = (hist->seg_head + hist->seg_count - i) % hist->seg_count;
+        seg = &hist->segs[cur->seg];
+
+        if (seg->count && seq >= seg->first_seq && seq < seg->first_seq + seg->count)
+            break;
+    }
+
+    cur->seq = seg->first_seq;
+    cur->offset = 0;
+
+    // Rebuild the table preceding the one wanted from the keyframe.
+    while (cur->seq < seq)
+        pm_delta_next(hist, cur);
+
+    return cur->seq;
+}
+
+int pm_delta_next(const struct pm_delta_history* hist, struct pm_delta_cursor* cur) {
+    const struct pm_delta_segment* seg = &hist->segs[cur->seg];
+    const u32 *rec, *values;
+    u32 i, bits;
+
+    if (cur->seq >= hist->next_seq)
+        return 0;
+
+    // Continue with the keyframe of the following segment.
+    if (cur->seq >= seg->first_seq + seg->count) {
+        cur->seg = (cur->seg + 1) % hist->seg_count;
+        cur->offset = 0;
+    }
+
+    rec = pm_delta_seg_data(hist, cur->seg) + cur->offset / sizeof(u32);
+
+    cur->timestamp = rec[0] | (u64)rec[1] << 32;
+
+    if (!cur->offset) {
+        memcpy(cur->table, rec + PM_DELTA_KEYFRAME_HDR_WORDS, hist->words * sizeof(u32));
+
+        cur->bitmap = NULL;
+        cur->values = cur->table;
+        cur->changed = hist->words;
+
+        cur->offset = (PM_DELTA_KEYFRAME_HDR_WORDS + hist->words) * sizeof(u32);
+    } else {
+        cur->changed = rec[2];
+        cur->bitmap = rec + PM_DELTA_DELTA_HDR_WORDS;
+        cur->values = cur->bitmap + hist->bitmap_words;
+
+        values = cur->values;
+
+        for (i = 0; i < hist->bitmap_words; i++) {
+            for (bits = cur->bitmap[i]; bits; bits &= bits - 1)
+                cur->table[i * 32 + pm_delta_ctz(bits)] = *values++;
+        }
+
+        cur->offset += (PM_DELTA_DELTA_HDR_WORDS + hist->bitmap_words + cur->changed) * sizeof(u32);
+    }
+
+    cur->seq++;
+
+    return 1;
+}
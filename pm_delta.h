@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Delta Compression */
+
+#ifndef __PM_DELTA_H__
+#define __PM_DELTA_H__
+
+/**
+ * Compact history of PM tables. Consecutive tables mostly differ in a handful of telemetry
+ *  values, so the history is split into segments each starting with a full copy of a table (the
+ *  keyframe) followed by deltas holding a bitmap of the 32-bit words which changed from the
+ *  previous table and the new value of each of them.
+ *
+ * The history is a ring of segments, appending to a full ring overwrites the oldest segment.
+ * A segment ends after PM_DELTA_KEYFRAME_INTERVAL tables or when its space runs out, so the amount
+ *  of tables held depends on how much they change.
+ *
+ * This has no dependencies on the kernel so that it may be built into userspace tools as well.
+ * Callers are responsible for serializing access to a history.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t  u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#endif
+
+/* Maximum amount of tables in a segment, bounding the amount of deltas applied by a lookup. */
+#define PM_DELTA_KEYFRAME_INTERVAL                    64
+
+/* Space reserved per delta, in changed words for every this many words of the table. */
+#define PM_DELTA_BUDGET_RATIO                         8
+
+struct pm_delta_segment {
+    /* Sequence number of the keyframe. */
+    u64                        first_seq;
+
+    /* Amount of tables and bytes stored, a segment with no tables is unused. */
+    u32                        count;
+    u32                        used;
+};
+
+struct pm_delta_history {
+    /* Size of the tables, in 32-bit words, and of the bitmap of a delta. */
+    u32                        words;
+    u32                        bitmap_words;
+
+    u32                        seg_count;
+    u32                        seg_size;
+
+    /* Segment currently appended to. */
+    u32                        seg_head;
+
+    /* Sequence number of the next table appended. */
+    u64                        next_seq;
+
+    struct pm_delta_segment*   segs;
+    u8*                        data;
+
+    /* Last table appended, which the next delta is taken against. */
+    u32*                       prev;
+};
+
+/**
+ * Sequential decoder of a history, holding the table last decoded.
+ */
+struct pm_delta_cursor {
+    /* Sequence number of the table which will be decoded next. */
+    u64                        seq;
+
+    u32                        seg;
+    u32                        offset;
+
+    /* Table and timestamp of the last decoded sample. */
+    u32*                       table;
+    u64                        timestamp;
+
+    /* Words of the last decoded table which changed, and their new values in order.
+     * The bitmap is NULL after a keyframe, in which case all words are considered changed. */
+    const u32*                 bitmap;
+    const u32*                 values;
+    u32                        changed;
+};
+
+/**
+ * Returns the amount of memory needed for a history of at least [count] tables of [size] bytes,
+ *  assuming few values change between tables, or 0 if [size] is not a multiple of 4.
+ */
+size_t pm_delta_mem_size(u32 size, u32 count);
+
+/**
+ * Sets up a history of tables of [size] bytes in [mem] of [mem_size] bytes, which must be 8-byte
+ *  aligned and is owned by the history until it is discarded.
+ *
+ * Returns 0 on success, -1 if the memory is too small for two segments or size is invalid.
+ */
+int pm_delta_init(struct pm_delta_history* hist, void* mem, size_t mem_size, u32 size);
+
+/**
+ * Appends a table, returning its sequence number.
+ */
+u64 pm_delta_append(struct pm_delta_history* hist, const void* table, u64 timestamp);
+
+/**
+ * Returns the sequence number of the oldest table held, equal to next_seq when empty.
+ */
+u64 pm_delta_oldest(const struct pm_delta_history* hist);
+
+/**
+ * Positions [cur] to decode the table with sequence number [seq] next, or the oldest one held if
+ *  it was already overwritten. [cur->table] must point to a buffer of the size of the tables,
+ *  which must not be modified in-between calls of pm_delta_next().
+ *
+ * Returns the sequence number of the table which will be decoded next.
+ */
+u64 pm_delta_seek(const struct pm_delta_history* hist, struct pm_delta_cursor* cur, u64 seq);
+
+/**
+ * Decodes the next table into [cur->table] and stores which words changed, which is cheaper than
+ *  copying the table out for consumers only interested in changes.
+ * The history must not have been appended to since the cursor was positioned, as the table may
+ *  have been overwritten. Positioning the cursor again with its sequence number resumes decoding.
+ *
+ * Returns 1 if a table was decoded, 0 if all tables held were already decoded.
+ */
+int pm_delta_next(const struct pm_delta_history* hist, struct pm_delta_cursor* cur);
+
+#endif /* __PM_DELTA_H__ */
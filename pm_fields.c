@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Fields */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+
+#include "pm_fields.h"
+#include "dev.h"
+
+struct pm_field_attr {
+    struct kobj_attribute          attr;
+    const struct pm_field*         field;
+    u32                            node;
+    u32                            offset;
+    char                           name[32];
+};
+
+struct pm_fields_dir {
+    struct kobject*                kobj;
+    const struct pm_schema*        schema;
+
+    struct kobj_attribute          schema_attr;
+    struct attribute_group         group;
+    struct attribute**             attrs;
+    struct pm_field_attr*          fattrs;
+};
+
+static const char* pm_field_type_name(const struct pm_field* field) {
+    switch (field->type) {
+        case PM_FIELD_F32:
+            return "f32";
+        default:
+            return "u32";
+    }
+}
+
+static ssize_t pm_field_show(struct kobject* kobj, struct kobj_attribute* attr, char* buff) {
+    struct pm_field_attr* fattr = container_of(attr, struct pm_field_attr, attr);
+    u32 raw;
+    int err;
+
+    err = smu_pm_dev_read_word(fattr->node, fattr->offset, RYZEN_SMU_PM_MAX_AGE_DEFAULT, &raw);
+    if (err)
+        return err;
+
+    return pm_field_format(fattr->field, raw, buff);
+}
+
+// One line per field: name, offset, type and unit. Arrays are listed once with their element count.
+static ssize_t pm_schema_show(struct kobject* kobj, struct kobj_attribute* attr, char* buff) {
+    struct pm_fields_dir* dir = container_of(attr, struct pm_fields_dir, schema_attr);
+    const struct pm_field* field;
+    ssize_t len = 0;
+    u32 i;
+
+    for (i = 0; i < dir->schema->field_count; i++) {
+        field = &dir->schema->fields[i];
+
+        len += scnprintf(buff + len, PAGE_SIZE - len, "%s[%u] 0x%03x %s %s\n",
+            field->name, field->count, field->offset, pm_field_type_name(field), field->unit);
+    }
+
+    return len;
+}
+
+static u32 pm_fields_attr_count(const struct pm_schema* schema) {
+    u32 i, count = 0;
+
+    for (i = 0; i < schema->field_count; i++)
+        count += schema->fields[i].count;
+
+    return count;
+}
+
+struct pm_fields_dir* pm_fields_create(struct kobject* parent, u32 node, const struct pm_schema* schema) {
+    const struct pm_field* field;
+    struct pm_field_attr* fattr;
+    struct pm_fields_dir* dir;
+    u32 i, j, count, n = 0;
+
+    dir = kzalloc(sizeof(*dir), GFP_KERNEL);
+    if (!dir)
+        return NULL;
+
+    count = pm_fields_attr_count(schema);
+
+    dir->schema = schema;
+    dir->fattrs = kcalloc(count, sizeof(*dir->fattrs), GFP_KERNEL);
+
+    // Every field attribute, the schema attribute and the terminating NULL.
+    dir->attrs = kcalloc(count + 2, sizeof(*dir->attrs), GFP_KERNEL);
+
+    if (!dir->fattrs || !dir->attrs)
+        goto BREAK_OUT;
+
+    for (i = 0; i < schema->field_count; i++) {
+        field = &schema->fields[i];
+
+        // Arrays get an attribute per element, suffixed by its index.
+        for (j = 0; j < field->count; j++, n++) {
+            fattr = &dir->fattrs[n];
+
+            if (field->count > 1)
+                snprintf(fattr->name, sizeof(fattr->name), "%s%u", field->name, j);
+            else
+                snprintf(fattr->name, sizeof(fattr->name), "%s", field->name);
+
+            sysfs_attr_init(&fattr->attr.attr);
+            fattr->attr.attr.name = fattr->name;
+            fattr->attr.attr.mode = S_IRUSR;
+            fattr->attr.show = pm_field_show;
+
+            fattr->field = field;
+            fattr->node = node;
+            fattr->offset = field->offset + j * sizeof(u32);
+
+            dir->attrs[n] = &fattr->attr.attr;
+        }
+    }
+
+    sysfs_attr_init(&dir->schema_attr.attr);
+    dir->schema_attr.attr.name = "schema";
+    dir->schema_attr.attr.mode = S_IRUSR;
+    dir->schema_attr.show = pm_schema_show;
+    dir->attrs[n] = &dir->schema_attr.attr;
+
+    dir->group.attrs = dir->attrs;
+
+    dir->kobj = kobject_create_and_add("pm_fields", parent);
+    if (!dir->kobj)
+        goto BREAK_OUT;
+
+    if (sysfs_create_group(dir->kobj, &dir->group)) {
+        kobject_put(dir->kobj);
+        goto BREAK_OUT;
+    }
+
+    return dir;
+
+BREAK_OUT:
+    kfree(dir->attrs);
+    kfree(dir->fattrs);
+    kfree(dir);
+
+    return NULL;
+}
+
+void pm_fields_destroy(struct pm_fields_dir* dir) {
+    if (!dir)
+        return;
+
+    // Removing the attributes waits for readers still inside of pm_field_show().
+    sysfs_remove_group(dir->kobj, &dir->group);
+    kobject_put(dir->kobj);
+
+    kfree(dir->attrs);
+    kfree(dir->fattrs);
+    kfree(dir);
+}
+
+struct kobject* pm_fields_kobj(struct pm_fields_dir* dir) {
+    return dir->kobj;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Fields */
+
+#ifndef __PM_FIELDS_H__
+#define __PM_FIELDS_H__
+
+#include <linux/types.h>
+#include <linux/kobject.h>
+
+#include "smu.h"
+#include "pm_schema.h"
+
+/**
+ * Exposes the values of the fields of a PM table schema individually under
+ *  ryzen_smu_drv/nodeN/pm_fields.
+ */
+
+struct pm_fields_dir;
+
+/**
+ * Creates a pm_fields directory under [parent] holding an attribute per field of [schema], which
+ *  read the values from the PM table snapshot of [node], or removes it.
+ *
+ * Returns NULL on failure.
+ */
+struct pm_fields_dir* pm_fields_create(struct kobject* parent, u32 node, const struct pm_schema* schema);
+void pm_fields_destroy(struct pm_fields_dir* dir);
+
+/**
+ * Returns the kobject of the directory, e.g. to link to it.
+ */
+struct kobject* pm_fields_kobj(struct pm_fields_dir* dir);
+
+#endif /* __PM_FIELDS_H__ */
@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Hardware Monitoring */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hwmon.h>
+
+#include "pm_hwmon.h"
+#include "dev.h"
+
+/**
+ * A channel is described by the names of the schema fields holding its value and, optionally, its
+ *  limit, so that every schema defining those fields gets the channel.
+ */
+struct pm_hwmon_sensor {
+    const char*                    label;
+    const char*                    input;
+    const char*                    limit;
+};
+
+// Channels of each type in the order of their hwmon numbering, which starts from in0 for voltages
+//  and from 1 for the others, e.g. in0 being VDDCR_CPU and power1 PPT.
+static const struct pm_hwmon_sensor pm_hwmon_power[] = {
+    { "PPT",       "ppt_value",             "ppt_limit" },
+    { "Socket",    "socket_power",          NULL        },
+    { "VDDCR_CPU", "vddcr_cpu_power",       NULL        },
+    { "VDDCR_SOC", "vddcr_soc_power",       NULL        },
+};
+
+static const struct pm_hwmon_sensor pm_hwmon_temp[] = {
+    { "Tctl",      "thm_value",             "thm_limit" },
+    { "Peak",      "peak_temp",             NULL        },
+};
+
+static const struct pm_hwmon_sensor pm_hwmon_in[] = {
+    { "VDDCR_CPU", "cpu_telemetry_voltage", NULL        },
+    { "VDDCR_SOC", "soc_telemetry_voltage", NULL        },
+    { "VDDP",      "v_vddp",                NULL        },
+    { "VDDG",      "v_vddg",                NULL        },
+};
+
+static const struct pm_hwmon_sensor pm_hwmon_curr[] = {
+    { "TDC",       "tdc_value",             "tdc_limit" },
+    { "EDC",       "edc_value",             "edc_limit" },
+    { "VDDCR_CPU", "cpu_telemetry_current", NULL        },
+    { "VDDCR_SOC", "soc_telemetry_current", NULL        },
+};
+
+#define PM_HWMON_MAX_CHANNELS                         4
+
+// The config arrays are terminated by a zero entry. Channels absent from the schema are hidden
+//  by pm_hwmon_is_visible().
+static const u32 pm_hwmon_power_config[] = {
+    HWMON_P_INPUT | HWMON_P_LABEL | HWMON_P_CAP,
+    HWMON_P_INPUT | HWMON_P_LABEL,
+    HWMON_P_INPUT | HWMON_P_LABEL,
+    HWMON_P_INPUT | HWMON_P_LABEL,
+    0
+};
+
+static const u32 pm_hwmon_temp_config[] = {
+    HWMON_T_INPUT | HWMON_T_LABEL | HWMON_T_MAX,
+    HWMON_T_INPUT | HWMON_T_LABEL,
+    0
+};
+
+static const u32 pm_hwmon_in_config[] = {
+    HWMON_I_INPUT | HWMON_I_LABEL,
+    HWMON_I_INPUT | HWMON_I_LABEL,
+    HWMON_I_INPUT | HWMON_I_LABEL,
+    HWMON_I_INPUT | HWMON_I_LABEL,
+    0
+};
+
+static const u32 pm_hwmon_curr_config[] = {
+    HWMON_C_INPUT | HWMON_C_LABEL | HWMON_C_MAX,
+    HWMON_C_INPUT | HWMON_C_LABEL | HWMON_C_MAX,
+    HWMON_C_INPUT | HWMON_C_LABEL,
+    HWMON_C_INPUT | HWMON_C_LABEL,
+    0
+};
+
+// HWMON_CHANNEL_INFO() is only available since 5.1.
+static const struct hwmon_channel_info pm_hwmon_power_info = { .type = hwmon_power, .config = pm_hwmon_power_config };
+static const struct hwmon_channel_info pm_hwmon_temp_info  = { .type = hwmon_temp,  .config = pm_hwmon_temp_config  };
+static const struct hwmon_channel_info pm_hwmon_in_info    = { .type = hwmon_in,    .config = pm_hwmon_in_config    };
+static const struct hwmon_channel_info pm_hwmon_curr_info  = { .type = hwmon_curr,  .config = pm_hwmon_curr_config  };
+
+static const struct hwmon_channel_info* pm_hwmon_info[] = {
+    &pm_hwmon_power_info,
+    &pm_hwmon_temp_info,
+    &pm_hwmon_in_info,
+    &pm_hwmon_curr_info,
+    NULL
+};
+
+enum pm_hwmon_type {
+    PM_HWMON_POWER,
+    PM_HWMON_TEMP,
+    PM_HWMON_IN,
+    PM_HWMON_CURR,
+
+    PM_HWMON_TYPE_COUNT
+};
+
+struct pm_hwmon {
+    struct device*                 hwmon;
+    u32                            node;
+
+    // Fields of the schema resolved for every channel, NULL for absent channels or limits.
+    const struct pm_field*         input[PM_HWMON_TYPE_COUNT][PM_HWMON_MAX_CHANNELS];
+    const struct pm_field*         limit[PM_HWMON_TYPE_COUNT][PM_HWMON_MAX_CHANNELS];
+};
+
+static const struct {
+    const struct pm_hwmon_sensor*  sensors;
+    u32                            count;
+
+    // Multiplier from the unit of the PM table (W, C, V, A) to the hwmon one (uW, mC, mV, mA).
+    u32                            scale;
+} pm_hwmon_types[PM_HWMON_TYPE_COUNT] = {
+    [PM_HWMON_POWER] = { pm_hwmon_power, ARRAY_SIZE(pm_hwmon_power), 1000000 },
+    [PM_HWMON_TEMP]  = { pm_hwmon_temp,  ARRAY_SIZE(pm_hwmon_temp),  1000    },
+    [PM_HWMON_IN]    = { pm_hwmon_in,    ARRAY_SIZE(pm_hwmon_in),    1000    },
+    [PM_HWMON_CURR]  = { pm_hwmon_curr,  ARRAY_SIZE(pm_hwmon_curr),  1000    },
+};
+
+static int pm_hwmon_type_of(enum hwmon_sensor_types type) {
+    switch (type) {
+        case hwmon_power:
+            return PM_HWMON_POWER;
+        case hwmon_temp:
+            return PM_HWMON_TEMP;
+        case hwmon_in:
+            return PM_HWMON_IN;
+        case hwmon_curr:
+            return PM_HWMON_CURR;
+        default:
+            return -EOPNOTSUPP;
+    }
+}
+
+static bool pm_hwmon_is_label(enum hwmon_sensor_types type, u32 attr) {
+    return (type == hwmon_power && attr == hwmon_power_label) ||
+        (type == hwmon_temp && attr == hwmon_temp_label) ||
+        (type == hwmon_in && attr == hwmon_in_label) ||
+        (type == hwmon_curr && attr == hwmon_curr_label);
+}
+
+static bool pm_hwmon_is_limit(enum hwmon_sensor_types type, u32 attr) {
+    return (type == hwmon_power && attr == hwmon_power_cap) ||
+        (type == hwmon_temp && attr == hwmon_temp_max) ||
+        (type == hwmon_curr && attr == hwmon_curr_max);
+}
+
+static umode_t pm_hwmon_is_visible(const void* data, enum hwmon_sensor_types type, u32 attr, int channel) {
+    const struct pm_hwmon* hwmon = data;
+    int t = pm_hwmon_type_of(type);
+
+    if (t < 0 || channel >= PM_HWMON_MAX_CHANNELS || !hwmon->input[t][channel])
+        return 0;
+
+    if (pm_hwmon_is_limit(type, attr) && !hwmon->limit[t][channel])
+        return 0;
+
+    // Power readings at a high rate are a side channel on what the processor executes, hence they
+    //  are restricted to root like the pm_fields attributes.
+    return S_IRUSR;
+}
+
+static int pm_hwmon_read(struct device* dev, enum hwmon_sensor_types type, u32 attr, int channel, long* val) {
+    struct pm_hwmon* hwmon = dev_get_drvdata(dev);
+    const struct pm_field* field;
+    int t = pm_hwmon_type_of(type);
+    u32 raw;
+    int err;
+
+    if (t < 0 || channel >= PM_HWMON_MAX_CHANNELS)
+        return -EOPNOTSUPP;
+
+    field = pm_hwmon_is_limit(type, attr) ? hwmon->limit[t][channel] : hwmon->input[t][channel];
+    if (!field)
+        return -EOPNOTSUPP;
+
+    // Until the table was read successfully there is no value, which hwmon consumers such as
+    //  sensors show as N/A rather than as an error.
+    err = smu_pm_dev_read_word(hwmon->node, field->offset, PM_HWMON_MAX_AGE_US, &raw);
+    if (err)
+        return err == -ENODEV || err == -EAGAIN ? -ENODATA : err;
+
+    return pm_field_scale(field, raw, pm_hwmon_types[t].scale, val);
+}
+
+static int pm_hwmon_read_string(struct device* dev, enum hwmon_sensor_types type, u32 attr, int channel,
+    const char** str) {
+    int t = pm_hwmon_type_of(type);
+
+    if (t < 0 || channel >= pm_hwmon_types[t].count || !pm_hwmon_is_label(type, attr))
+        return -EOPNOTSUPP;
+
+    *str = pm_hwmon_types[t].sensors[channel].label;
+
+    return 0;
+}
+
+static const struct hwmon_ops pm_hwmon_ops = {
+    .is_visible  = pm_hwmon_is_visible,
+    .read        = pm_hwmon_read,
+    .read_string = pm_hwmon_read_string,
+};
+
+static const struct hwmon_chip_info pm_hwmon_chip_info = {
+    .ops  = &pm_hwmon_ops,
+    .info = pm_hwmon_info,
+};
+
+struct pm_hwmon* pm_hwmon_register(struct pci_dev* dev, u32 node, const struct pm_schema* schema) {
+    const struct pm_hwmon_sensor* sensor;
+    struct pm_hwmon* hwmon;
+    u32 t, i, found = 0;
+
+    BUILD_BUG_ON(ARRAY_SIZE(pm_hwmon_power) != ARRAY_SIZE(pm_hwmon_power_config) - 1);
+    BUILD_BUG_ON(ARRAY_SIZE(pm_hwmon_temp) != ARRAY_SIZE(pm_hwmon_temp_config) - 1);
+    BUILD_BUG_ON(ARRAY_SIZE(pm_hwmon_in) != ARRAY_SIZE(pm_hwmon_in_config) - 1);
+    BUILD_BUG_ON(ARRAY_SIZE(pm_hwmon_curr) != ARRAY_SIZE(pm_hwmon_curr_config) - 1);
+
+    hwmon = kzalloc(sizeof(*hwmon), GFP_KERNEL);
+    if (!hwmon)
+        return NULL;
+
+    hwmon->node = node;
+
+    for (t = 0; t < PM_HWMON_TYPE_COUNT; t++) {
+        for (i = 0; i < pm_hwmon_types[t].count; i++) {
+            sensor = &pm_hwmon_types[t].sensors[i];
+
+            hwmon->input[t][i] = pm_schema_field(schema, sensor->input);
+            if (!hwmon->input[t][i])
+                continue;
+
+            if (sensor->limit)
+                hwmon->limit[t][i] = pm_schema_field(schema, sensor->limit);
+
+            found++;
+        }
+    }
+
+    if (!found)
+        goto BREAK_OUT;
+
+    hwmon->hwmon = hwmon_device_register_with_info(&dev->dev, "ryzen_smu", hwmon, &pm_hwmon_chip_info, NULL);
+    if (IS_ERR(hwmon->hwmon))
+        goto BREAK_OUT;
+
+    return hwmon;
+
+BREAK_OUT:
+    kfree(hwmon);
+
+    return NULL;
+}
+
+void pm_hwmon_unregister(struct pm_hwmon* hwmon) {
+    if (!hwmon)
+        return;
+
+    // Waits for readers of the attributes, which may still be reading the snapshot.
+    hwmon_device_unregister(hwmon->hwmon);
+    kfree(hwmon);
+}
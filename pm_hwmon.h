@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Hardware Monitoring */
+
+#ifndef __PM_HWMON_H__
+#define __PM_HWMON_H__
+
+#include <linux/pci.h>
+#include <linux/kconfig.h>
+
+#include "pm_fields.h"
+
+/**
+ * Registers a hwmon device exposing the power, temperature, voltage and current channels of the PM
+ *  table, decoded through the fields of its schema, for lm-sensors and other hwmon consumers.
+ *
+ * Channels read from the snapshot of /dev/ryzen_smu_pm and accept a table up to
+ *  PM_HWMON_MAX_AGE_US old, so reading every channel in a row costs a single transfer by the SMU.
+ */
+
+/* Age of the PM table accepted by hwmon channels, in the spirit of the usual hwmon update interval. */
+#define PM_HWMON_MAX_AGE_US                           100000
+
+struct pm_hwmon;
+
+#if IS_REACHABLE(CONFIG_HWMON)
+
+/**
+ * Registers the hwmon device of the PM table of [node], laid out as [schema], below [dev] or
+ *  unregisters it.
+ *
+ * Returns NULL on failure or if none of the channels are found in the schema.
+ */
+struct pm_hwmon* pm_hwmon_register(struct pci_dev* dev, u32 node, const struct pm_schema* schema);
+void pm_hwmon_unregister(struct pm_hwmon* hwmon);
+
+#else
+
+static inline struct pm_hwmon* pm_hwmon_register(struct pci_dev* dev, u32 node, const struct pm_schema* schema) {
+    return NULL;
+}
+
+static inline void pm_hwmon_unregister(struct pm_hwmon* hwmon) {
+}
+
+#endif
+
+#endif /* __PM_HWMON_H__ */
@@ -0,0 +1,536 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Perf Events */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/cpuhotplug.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/perf_event.h>
+#include <linux/version.h>
+
+#include "pm_perf.h"
+#include "dev.h"
+
+// Interval at which active events sample their field. The value is held between two samples, so
+//  this bounds the resolution of the integral, and every sample has a stale snapshot refreshed.
+#define PM_PERF_SAMPLE_INTERVAL_NS                    (10 * NSEC_PER_MSEC)
+
+// Events count thousandths of the unit of the field times microseconds.
+#define PM_PERF_VALUE_SCALE                           1000
+#define PM_PERF_EVENT_SCALE                           "1e-9"
+
+/**
+ * Sysfs attribute with a generated name and contents, used for the events of the schema.
+ */
+struct pm_perf_attr {
+    struct device_attribute        attr;
+    char                           name[40];
+    char                           value[24];
+};
+
+struct pm_perf {
+    struct pmu                     pmu;
+    struct hlist_node              hp_node;
+    u32                            node;
+
+    // CPU every event is counted on, moved to another one when it goes offline.
+    int                            cpu;
+
+    const struct pm_schema*        schema;
+    char                           name[16];
+
+    // Whether the PMU is registered, which it remains while events exist even once the node went
+    //  away, see pm_perf_unregister().
+    bool                           registered;
+
+    // Set while the node is gone, after which no events are created and active ones stop sampling.
+    bool                           gone;
+
+    // Amount of events created on the PMU which were not destroyed yet.
+    atomic_t                       event_count;
+
+    // Three attributes per event: the event itself, its unit and its scale.
+    struct pm_perf_attr*           attrs;
+    struct attribute**             events;
+    struct attribute_group         events_group;
+    const struct attribute_group*  groups[4];
+};
+
+struct pm_perf_event {
+    const struct pm_field*         field;
+    u32                            offset;
+
+    // Last value sampled, in thousandths of the unit of the field, and up to when it was counted.
+    long                           value;
+    u64                            counted_ns;
+};
+
+static enum cpuhp_state pm_perf_hp_state = CPUHP_INVALID;
+
+// Before Linux 6.15 a PMU can't be unregistered while events exist, which keep calling into it, so
+//  the PMU of every node is only freed when the module is unloaded, at which point perf holds no
+//  events anymore, and reused when the node is bound again.
+static struct pm_perf* pm_perf_nodes[SMU_MAX_NODES];
+
+// Serializes registering and unregistering PMUs.
+static DEFINE_MUTEX(pm_perf_lock);
+
+static struct pm_perf* pm_perf_of(struct pmu* pmu) {
+    return container_of(pmu, struct pm_perf, pmu);
+}
+
+PMU_FORMAT_ATTR(offset, "config:0-15");
+
+static struct attribute* pm_perf_format_attrs[] = {
+    &format_attr_offset.attr,
+    NULL
+};
+
+static const struct attribute_group pm_perf_format_group = {
+    .name  = "format",
+    .attrs = pm_perf_format_attrs,
+};
+
+static ssize_t cpumask_show(struct device* dev, struct device_attribute* attr, char* buff) {
+    struct pm_perf* perf = pm_perf_of(dev_get_drvdata(dev));
+
+    return cpumap_print_to_pagebuf(true, buff, cpumask_of(perf->cpu));
+}
+
+static DEVICE_ATTR_RO(cpumask);
+
+static struct attribute* pm_perf_cpumask_attrs[] = {
+    &dev_attr_cpumask.attr,
+    NULL
+};
+
+static const struct attribute_group pm_perf_cpumask_group = {
+    .attrs = pm_perf_cpumask_attrs,
+};
+
+static ssize_t pm_perf_attr_show(struct device* dev, struct device_attribute* attr, char* buff) {
+    return sprintf(buff, "%s\n", container_of(attr, struct pm_perf_attr, attr)->value);
+}
+
+// Returns the field holding the word at [offset] of the table, which may be an element of an array.
+static const struct pm_field* pm_perf_find(const struct pm_schema* schema, u64 offset) {
+    const struct pm_field* field;
+    u32 i;
+
+    if (offset % sizeof(u32))
+        return NULL;
+
+    for (i = 0; i < schema->field_count; i++) {
+        field = &schema->fields[i];
+
+        if (offset >= field->offset && offset < field->offset + field->count * sizeof(u32))
+            return field;
+    }
+
+    return NULL;
+}
+
+/**
+ * Counts the last value sampled up to now and samples the field again. Called with interrupts
+ *  disabled on the CPU of the event, either by perf or from the timer of the event.
+ */
+static void pm_perf_event_update(struct perf_event* event) {
+    struct pm_perf* perf = pm_perf_of(event->pmu);
+    struct pm_perf_event* pe = event->pmu_private;
+    u64 now = ktime_get_ns();
+    long value;
+    u32 raw;
+    u64 us;
+
+    // Only whole microseconds are counted so that the remainder is carried over to the next update.
+    us = div_u64(now - pe->counted_ns, NSEC_PER_USEC);
+    pe->counted_ns += us * NSEC_PER_USEC;
+
+    local64_add((s64)pe->value * (s64)us, &event->count);
+
+    // The snapshot is removed along with the node, nothing is counted once it is gone.
+    rcu_read_lock();
+
+    if (READ_ONCE(perf->gone))
+        pe->value = 0;
+    // The previous value is kept while the snapshot is being refreshed.
+    else if (!smu_pm_dev_peek_word(perf->node, pe->offset, &raw) &&
+        !pm_field_scale(pe->field, raw, PM_PERF_VALUE_SCALE, &value))
+        pe->value = value;
+
+    rcu_read_unlock();
+}
+
+static enum hrtimer_restart pm_perf_hrtimer(struct hrtimer* timer) {
+    struct perf_event* event = container_of(timer, struct perf_event, hw.hrtimer);
+
+    if (event->hw.state & PERF_HES_STOPPED)
+        return HRTIMER_NORESTART;
+
+    pm_perf_event_update(event);
+
+    hrtimer_forward_now(timer, ns_to_ktime(PM_PERF_SAMPLE_INTERVAL_NS));
+
+    return HRTIMER_RESTART;
+}
+
+static void pm_perf_event_destroy(struct perf_event* event) {
+    kfree(event->pmu_private);
+    atomic_dec(&pm_perf_of(event->pmu)->event_count);
+}
+
+static int pm_perf_event_init(struct perf_event* event) {
+    struct pm_perf* perf = pm_perf_of(event->pmu);
+    const struct pm_field* field;
+    struct pm_perf_event* pe;
+
+    if (event->attr.type != event->pmu->type)
+        return -ENOENT;
+
+    // The fields describe the whole processor, so like other uncore PMUs, events can't follow tasks.
+    if (event->cpu < 0 || (event->attach_state & PERF_ATTACH_TASK))
+        return -EINVAL;
+
+    field = pm_perf_find(perf->schema, event->attr.config);
+    if (!field)
+        return -EINVAL;
+
+    pe = kzalloc(sizeof(*pe), GFP_KERNEL);
+    if (!pe)
+        return -ENOMEM;
+
+    pe->field = field;
+    pe->offset = event->attr.config;
+
+    // Paired with pm_perf_unregister(), either the event is refused or the PMU stays registered.
+    atomic_inc(&perf->event_count);
+    smp_mb__after_atomic();
+
+    if (READ_ONCE(perf->gone)) {
+        atomic_dec(&perf->event_count);
+        kfree(pe);
+        return -ENODEV;
+    }
+
+    event->pmu_private = pe;
+    event->destroy = pm_perf_event_destroy;
+
+    // Every event of the PMU is counted on the same CPU, see pm_perf_cpu_offline().
+    event->cpu = perf->cpu;
+    event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&event->hw.hrtimer, pm_perf_hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+    hrtimer_init(&event->hw.hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    event->hw.hrtimer.function = pm_perf_hrtimer;
+#endif
+
+    return 0;
+}
+
+static void pm_perf_event_start(struct perf_event* event, int flags) {
+    struct pm_perf_event* pe = event->pmu_private;
+
+    event->hw.state = 0;
+
+    // Nothing is counted before the first sample.
+    pe->value = 0;
+    pe->counted_ns = ktime_get_ns();
+    pm_perf_event_update(event);
+
+    hrtimer_start(&event->hw.hrtimer, ns_to_ktime(PM_PERF_SAMPLE_INTERVAL_NS), HRTIMER_MODE_REL_PINNED);
+}
+
+static void pm_perf_event_stop(struct perf_event* event, int flags) {
+    if (event->hw.state & PERF_HES_STOPPED)
+        return;
+
+    hrtimer_cancel(&event->hw.hrtimer);
+
+    pm_perf_event_update(event);
+    event->hw.state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+}
+
+static int pm_perf_event_add(struct perf_event* event, int flags) {
+    event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+
+    if (flags & PERF_EF_START)
+        pm_perf_event_start(event, flags);
+
+    return 0;
+}
+
+static void pm_perf_event_del(struct perf_event* event, int flags) {
+    pm_perf_event_stop(event, PERF_EF_UPDATE);
+}
+
+static void pm_perf_event_read(struct perf_event* event) {
+    if (!(event->hw.state & PERF_HES_STOPPED))
+        pm_perf_event_update(event);
+}
+
+static int pm_perf_cpu_offline(unsigned int cpu, struct hlist_node* node) {
+    struct pm_perf* perf = hlist_entry_safe(node, struct pm_perf, hp_node);
+    unsigned int target;
+
+    if (cpu != perf->cpu)
+        return 0;
+
+    target = cpumask_any_but(cpu_online_mask, cpu);
+    if (target >= nr_cpu_ids)
+        return 0;
+
+    perf_pmu_migrate_context(&perf->pmu, cpu, target);
+    perf->cpu = target;
+
+    return 0;
+}
+
+int pm_perf_init(void) {
+    int ret;
+
+    ret = cpuhp_setup_state_multi(CPUHP_AP_ONLINE_DYN, "ryzen_smu/perf:online", NULL, pm_perf_cpu_offline);
+    if (ret < 0)
+        return ret;
+
+    pm_perf_hp_state = ret;
+
+    return 0;
+}
+
+static void pm_perf_attr_init(struct pm_perf_attr* pattr) {
+    sysfs_attr_init(&pattr->attr.attr);
+    pattr->attr.attr.name = pattr->name;
+    pattr->attr.attr.mode = 0444;
+    pattr->attr.show = pm_perf_attr_show;
+}
+
+// Creates the event, unit and scale attributes of the word at [offset], the [index] of [field].
+static void pm_perf_event_attrs_init(struct pm_perf_attr* pattr, const struct pm_field* field, u32 index) {
+    u32 offset = field->offset + index * sizeof(u32);
+    char name[32];
+
+    // Elements of arrays are suffixed by their index, e.g. core_freq_3.
+    if (field->count > 1)
+        snprintf(name, sizeof(name), "%s_%u", field->name, index);
+    else
+        snprintf(name, sizeof(name), "%s", field->name);
+
+    snprintf(pattr[0].name, sizeof(pattr[0].name), "%s", name);
+    snprintf(pattr[0].value, sizeof(pattr[0].value), "offset=0x%03x", offset);
+
+    // The integral of power is energy, anything else is left as the unit times seconds.
+    snprintf(pattr[1].name, sizeof(pattr[1].name), "%s.unit", name);
+    if (!strcmp(field->unit, "W"))
+        snprintf(pattr[1].value, sizeof(pattr[1].value), "Joules");
+    else
+        snprintf(pattr[1].value, sizeof(pattr[1].value), "%s*s", field->unit);
+
+    snprintf(pattr[2].name, sizeof(pattr[2].name), "%s.scale", name);
+    snprintf(pattr[2].value, sizeof(pattr[2].value), PM_PERF_EVENT_SCALE);
+
+    pm_perf_attr_init(&pattr[0]);
+    pm_perf_attr_init(&pattr[1]);
+    pm_perf_attr_init(&pattr[2]);
+}
+
+static void pm_perf_free(struct pm_perf* perf) {
+    kfree(perf->events);
+    kfree(perf->attrs);
+    kfree(perf);
+}
+
+// Creates the attributes of every event of [schema]. Returns 0 on success.
+static int pm_perf_events_init(struct pm_perf* perf, const struct pm_schema* schema) {
+    const struct pm_field* field;
+    u32 i, j, count = 0, n = 0;
+
+    for (i = 0; i < schema->field_count; i++)
+        count += schema->fields[i].count;
+
+    kfree(perf->events);
+    kfree(perf->attrs);
+
+    perf->schema = NULL;
+    perf->attrs = kcalloc(count * 3, sizeof(*perf->attrs), GFP_KERNEL);
+    perf->events = kcalloc(count * 3 + 1, sizeof(*perf->events), GFP_KERNEL);
+
+    if (!perf->attrs || !perf->events)
+        return -ENOMEM;
+
+    for (i = 0; i < schema->field_count; i++) {
+        field = &schema->fields[i];
+
+        for (j = 0; j < field->count; j++, n += 3) {
+            pm_perf_event_attrs_init(&perf->attrs[n], field, j);
+
+            perf->events[n + 0] = &perf->attrs[n + 0].attr.attr;
+            perf->events[n + 1] = &perf->attrs[n + 1].attr.attr;
+            perf->events[n + 2] = &perf->attrs[n + 2].attr.attr;
+        }
+    }
+
+    perf->schema = schema;
+
+    return 0;
+}
+
+// Callers must hold pm_perf_lock.
+static void pm_perf_pmu_unregister(struct pm_perf* perf) {
+    if (!perf->registered)
+        return;
+
+    perf_pmu_unregister(&perf->pmu);
+    cpuhp_state_remove_instance_nocalls(pm_perf_hp_state, &perf->hp_node);
+
+    perf->registered = false;
+}
+
+struct pm_perf* pm_perf_register(u32 node, const struct pm_schema* schema) {
+    struct pm_perf* perf;
+    int err;
+
+    if (pm_perf_hp_state == CPUHP_INVALID || node >= SMU_MAX_NODES)
+        return NULL;
+
+    mutex_lock(&pm_perf_lock);
+
+    perf = pm_perf_nodes[node];
+
+    // The PMU of the previous binding of the node was kept for events which are still open.
+    if (perf && perf->registered) {
+        if (perf->schema != schema) {
+            pr_warn("Perf PMU %s has open events of another PM table layout", perf->name);
+            perf = NULL;
+            goto BREAK_OUT;
+        }
+
+        WRITE_ONCE(perf->gone, false);
+        goto BREAK_OUT;
+    }
+
+    if (!perf) {
+        perf = kzalloc(sizeof(*perf), GFP_KERNEL);
+        if (!perf)
+            goto BREAK_OUT;
+
+        perf->node = node;
+        atomic_set(&perf->event_count, 0);
+
+        // Named like the character devices of the node.
+        if (node)
+            snprintf(perf->name, sizeof(perf->name), "ryzen_smu%u", node);
+        else
+            snprintf(perf->name, sizeof(perf->name), "ryzen_smu");
+
+        pm_perf_nodes[node] = perf;
+    }
+
+    if (perf->schema != schema && pm_perf_events_init(perf, schema)) {
+        perf = NULL;
+        goto BREAK_OUT;
+    }
+
+    perf->events_group.name = "events";
+    perf->events_group.attrs = perf->events;
+
+    perf->groups[0] = &perf->events_group;
+    perf->groups[1] = &pm_perf_format_group;
+    perf->groups[2] = &pm_perf_cpumask_group;
+
+    perf->pmu = (struct pmu) {
+        .module       = THIS_MODULE,
+        .task_ctx_nr  = perf_invalid_context,
+        .attr_groups  = perf->groups,
+        .capabilities = PERF_PMU_CAP_NO_INTERRUPT,
+        .event_init   = pm_perf_event_init,
+        .add          = pm_perf_event_add,
+        .del          = pm_perf_event_del,
+        .start        = pm_perf_event_start,
+        .stop         = pm_perf_event_stop,
+        .read         = pm_perf_event_read,
+    };
+
+    WRITE_ONCE(perf->gone, false);
+
+    // The CPU must not go offline before the PMU is known to the hotplug callback.
+    cpus_read_lock();
+
+    perf->cpu = cpumask_first(cpu_online_mask);
+    err = cpuhp_state_add_instance_nocalls_cpuslocked(pm_perf_hp_state, &perf->hp_node);
+
+    cpus_read_unlock();
+
+    if (err) {
+        pr_err("Unable to track CPU hotplug for perf PMU %s: %d", perf->name, err);
+        perf = NULL;
+        goto BREAK_OUT;
+    }
+
+    err = perf_pmu_register(&perf->pmu, perf->name, -1);
+    if (err) {
+        cpuhp_state_remove_instance_nocalls(pm_perf_hp_state, &perf->hp_node);
+        perf = NULL;
+        goto BREAK_OUT;
+    }
+
+    perf->registered = true;
+
+BREAK_OUT:
+    mutex_unlock(&pm_perf_lock);
+
+    return perf;
+}
+
+void pm_perf_unregister(struct pm_perf* perf) {
+    if (!perf)
+        return;
+
+    mutex_lock(&pm_perf_lock);
+
+    // Paired with pm_perf_event_init(), no events are created from now on.
+    WRITE_ONCE(perf->gone, true);
+    smp_mb();
+
+    // Active events stop sampling the snapshot of the node, which is removed after the PMU.
+    synchronize_rcu();
+
+    // Events which are still open keep calling into the PMU until they are closed, in which case
+    //  it remains registered, without events to create, until the node is bound again.
+    if (!atomic_read(&perf->event_count))
+        pm_perf_pmu_unregister(perf);
+    else
+        pr_info("Keeping perf PMU %s registered for its open events", perf->name);
+
+    mutex_unlock(&pm_perf_lock);
+}
+
+void pm_perf_cleanup(void) {
+    u32 i;
+
+    if (pm_perf_hp_state == CPUHP_INVALID)
+        return;
+
+    // Events hold a reference to the module, so none exist anymore once it is unloaded.
+    mutex_lock(&pm_perf_lock);
+
+    for (i = 0; i < SMU_MAX_NODES; i++) {
+        if (!pm_perf_nodes[i])
+            continue;
+
+        pm_perf_pmu_unregister(pm_perf_nodes[i]);
+        pm_perf_free(pm_perf_nodes[i]);
+        pm_perf_nodes[i] = NULL;
+    }
+
+    mutex_unlock(&pm_perf_lock);
+
+    cpuhp_remove_multi_state(pm_perf_hp_state);
+    pm_perf_hp_state = CPUHP_INVALID;
+}
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Perf Events */
+
+#ifndef __PM_PERF_H__
+#define __PM_PERF_H__
+
+#include <linux/types.h>
+#include <linux/kconfig.h>
+
+#include "pm_fields.h"
+
+/**
+ * Registers a perf PMU per node, named like its character devices, with an event per field of the
+ *  PM table schema, e.g. ryzen_smu/socket_power/ or ryzen_smu/core_freq_3/.
+ *
+ * Events read the snapshot of /dev/ryzen_smu_pm and count the integral of the field over time, in
+ *  units of the field times seconds, so that counting over any interval yields the energy for power
+ *  fields or the average value once divided by the interval. Events are counting only, an hrtimer
+ *  samples the field of every active event at a fixed interval and perf can't generate overflow
+ *  samples (perf record) from them.
+ */
+struct pm_perf;
+
+#if IS_REACHABLE(CONFIG_PERF_EVENTS)
+
+/**
+ * Sets up or tears down the CPU hotplug state used to keep the events on an online CPU.
+ *
+ * Returns 0 on success, anything else on failure. The driver remains usable on failure.
+ */
+int pm_perf_init(void);
+void pm_perf_cleanup(void);
+
+/**
+ * Registers the PMU of [node], with the fields of [schema] as its events, or unregisters it.
+ *
+ * Returns NULL on failure.
+ */
+struct pm_perf* pm_perf_register(u32 node, const struct pm_schema* schema);
+void pm_perf_unregister(struct pm_perf* perf);
+
+#else
+
+static inline int pm_perf_init(void) {
+    return 0;
+}
+
+static inline void pm_perf_cleanup(void) {
+}
+
+static inline struct pm_perf* pm_perf_register(u32 node, const struct pm_schema* schema) {
+    return NULL;
+}
+
+static inline void pm_perf_unregister(struct pm_perf* perf) {
+}
+
+#endif
+
+#endif /* __PM_PERF_H__ */
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Schemas */
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#else
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+
+#define U64_MAX                         ULLONG_MAX
+#define ARRAY_SIZE(x)                   (sizeof(x) / sizeof((x)[0]))
+#define min_t(type, x, y)               ((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+#define div_u64_rem(x, y, rem)          (*(rem) = (x) % (y), (x) / (y))
+#endif
+
+#include "pm_schema.h"
+
+#define PM_F32(_name, _unit, _offset) \
+    { .name = _name, .unit = _unit, .offset = _offset, .type = PM_FIELD_F32, .count = 1 }
+
+#define PM_F32_ARRAY(_name, _unit, _offset, _count) \
+    { .name = _name, .unit = _unit, .offset = _offset, .type = PM_FIELD_F32, .count = _count }
+
+// Matisse, e.g. Ryzen 7 3700X and 3800X. Also see pm_table_0x240903 in userspace/monitor_cpu.c.
+static const struct pm_field pm_fields_matisse_0x240903[] = {
+    PM_F32("ppt_limit",             "W",   0x000),
+    PM_F32("ppt_value",             "W",   0x004),
+    PM_F32("tdc_limit",             "A",   0x008),
+    PM_F32("tdc_value",             "A",   0x00C),
+    PM_F32("thm_limit",             "C",   0x010),
+    PM_F32("thm_value",             "C",   0x014),
+    PM_F32("edc_limit",             "A",   0x020),
+    PM_F32("edc_value",             "A",   0x024),
+    PM_F32("vddcr_cpu_power",       "W",   0x060),
+    PM_F32("vddcr_soc_power",       "W",   0x064),
+    PM_F32("socket_power",          "W",   0x074),
+    PM_F32("cpu_telemetry_voltage", "V",   0x0A0),
+    PM_F32("cpu_telemetry_current", "A",   0x0A4),
+    PM_F32("cpu_telemetry_power",   "W",   0x0A8),
+    PM_F32("soc_set_voltage",       "V",   0x0B0),
+    PM_F32("soc_telemetry_voltage", "V",   0x0B4),
+    PM_F32("soc_telemetry_current", "A",   0x0B8),
+    PM_F32("soc_telemetry_power",   "W",   0x0BC),
+    PM_F32("fclk_freq",             "MHz", 0x0C0),
+    PM_F32("fclk_freq_eff",         "MHz", 0x0C4),
+    PM_F32("uclk_freq",             "MHz", 0x0C8),
+    PM_F32("memclk_freq",           "MHz", 0x0CC),
+    PM_F32("v_vddp",                "V",   0x1F4),
+    PM_F32("v_vddg",                "V",   0x1F8),
+    PM_F32("peak_temp",             "C",   0x1FC),
+    PM_F32("peak_voltage",          "V",   0x200),
+    PM_F32_ARRAY("core_power",      "W",   0x24C, 8),
+    PM_F32_ARRAY("core_voltage",    "V",   0x26C, 8),
+    PM_F32_ARRAY("core_temp",       "C",   0x28C, 8),
+    PM_F32_ARRAY("core_freq",       "GHz", 0x2EC, 8),
+    PM_F32_ARRAY("core_freqeff",    "GHz", 0x30C, 8),
+    PM_F32_ARRAY("core_c0",         "%",   0x32C, 8),
+    PM_F32_ARRAY("core_cc6",        "%",   0x36C, 8),
+};
+
+#define PM_SCHEMA(_codename, _version, _fields) \
+    { .codename = _codename, .version = _version, .fields = _fields, .field_count = ARRAY_SIZE(_fields) }
+
+static const struct pm_schema pm_schemas[] = {
+    PM_SCHEMA(CODENAME_MATISSE, 0x240903, pm_fields_matisse_0x240903),
+};
+
+const struct pm_schema* pm_schema_find(enum smu_processor_codename codename, u32 version) {
+    u32 i;
+
+    for (i = 0; i < ARRAY_SIZE(pm_schemas); i++)
+        if (pm_schemas[i].codename == codename && pm_schemas[i].version == version)
+            return &pm_schemas[i];
+
+    return NULL;
+}
+
+// Returns |value| * [scale] of the float [raw], rounded to an integer and saturated.
+//  Denormals are too small to matter at any of the scales used.
+static u64 pm_f32_abs_scaled(u32 raw, u32 scale) {
+    u32 exp = (raw >> 23) & 0xFF;
+    u64 prod;
+    int shift;
+
+    if (exp == 0)
+        return 0;
+
+    // The value is (1.mant * 2^(exp - 127)), i.e. the mantissa shifted by (exp - 150).
+    prod = (u64)((raw & 0x7FFFFF) | (1 << 23)) * scale;
+    shift = exp - 150;
+
+    if (shift >= 0)
+        return shift >= 64 || prod > (U64_MAX >> shift) ? U64_MAX : prod << shift;
+
+    if (shift <= -64)
+        return 0;
+
+    return (prod >> -shift) + ((prod >> (-shift - 1)) & 1);
+}
+
+static bool pm_f32_is_finite(u32 raw) {
+    return ((raw >> 23) & 0xFF) != 0xFF;
+}
+
+static int pm_field_format_f32(u32 raw, char* buf) {
+    const char* sign = raw >> 31 ? "-" : "";
+    u64 milli, whole;
+    u32 frac;
+
+    if (!pm_f32_is_finite(raw))
+        return sprintf(buf, "%s\n", raw & 0x7FFFFF ? "nan" : raw >> 31 ? "-inf" : "inf");
+
+    milli = pm_f32_abs_scaled(raw, 1000);
+    if (!milli)
+        sign = "";
+
+    // Values too large for thousandths are whole numbers, as floats have no fraction above 2^23,
+    //  and are saturated like pm_field_scale() beyond that.
+    if (milli == U64_MAX) {
+        whole = pm_f32_abs_scaled(raw, 1);
+        frac = 0;
+    }
+    else {
+        whole = div_u64_rem(milli, 1000, &frac);
+    }
+
+    return sprintf(buf, "%s%llu.%03u\n", sign, whole, frac);
+}
+
+int pm_field_format(const struct pm_field* field, u32 raw, char* buf) {
+    switch (field->type) {
+        case PM_FIELD_F32:
+            return pm_field_format_f32(raw, buf);
+        default:
+            return sprintf(buf, "%u\n", raw);
+    }
+}
+
+int pm_field_scale(const struct pm_field* field, u32 raw, u32 scale, long* value) {
+    u64 abs;
+
+    switch (field->type) {
+        case PM_FIELD_F32:
+            if (!pm_f32_is_finite(raw))
+                return -ENODATA;
+
+            abs = min_t(u64, pm_f32_abs_scaled(raw, scale), LONG_MAX);
+            *value = raw >> 31 ? -(long)abs : (long)abs;
+            return 0;
+        default:
+            *value = min_t(u64, (u64)raw * scale, LONG_MAX);
+            return 0;
+    }
+}
+
+const struct pm_field* pm_schema_field(const struct pm_schema* schema, const char* name) {
+    u32 i;
+
+    for (i = 0; i < schema->field_count; i++)
+        if (!strcmp(schema->fields[i].name, name))
+            return &schema->fields[i];
+
+    return NULL;
+}
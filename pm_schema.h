@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU PM Table Schemas */
+
+#ifndef __PM_SCHEMA_H__
+#define __PM_SCHEMA_H__
+
+/**
+ * Registry of the layouts of known PM table versions, describing the fields of each and how their
+ *  values are decoded.
+ *
+ * This has no dependencies on the kernel so that it may be built into userspace tools as well, e.g.
+ *  to check the decoding against dumps of the table.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+
+typedef uint8_t            u8;
+typedef uint16_t           u16;
+typedef uint32_t           u32;
+typedef unsigned long long u64;
+#endif
+
+#include "smu_codename.h"
+
+enum pm_field_type {
+    PM_FIELD_F32,
+    PM_FIELD_U32,
+};
+
+struct pm_field {
+    const char*                name;
+    const char*                unit;
+    u16                        offset;
+    u8                         type;
+
+    // Amount of consecutive values, exposed as [name]0 to [name]N-1 when above 1.
+    u8                         count;
+};
+
+struct pm_schema {
+    enum smu_processor_codename codename;
+    u32                        version;
+    const struct pm_field*     fields;
+    u32                        field_count;
+};
+
+/**
+ * Returns the layout of the PM table [version] of [codename], NULL if it is unknown.
+ */
+const struct pm_schema* pm_schema_find(enum smu_processor_codename codename, u32 version);
+
+/**
+ * Formats the value [raw] of [field] into the sysfs buffer [buf], followed by a newline.
+ * Floating point values are printed with three decimals without using the FPU.
+ *
+ * Returns the amount of characters written.
+ */
+int pm_field_format(const struct pm_field* field, u32 raw, char* buf);
+
+/**
+ * Converts the value [raw] of [field] to an integer in units of 1/[scale], e.g. 1000000 for
+ *  microwatts from watts, rounding to the nearest integer.
+ *
+ * Returns 0 on success, -ENODATA if the value is not a number or infinite.
+ */
+int pm_field_scale(const struct pm_field* field, u32 raw, u32 scale, long* value);
+
+/**
+ * Returns the field of [schema] called [name], NULL if it has none.
+ */
+const struct pm_field* pm_schema_field(const struct pm_schema* schema, const char* name);
+
+#endif /* __PM_SCHEMA_H__ */
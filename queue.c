@@ -0,0 +1,303 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Asynchronous Command Queue */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/kref.h>
+#include <linux/spinlock.h>
+#include <linux/rwsem.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include "smu.h"
+#include "queue.h"
+
+struct smu_queue_client {
+    struct kref                    ref;
+    struct pci_dev*                dev;
+    u32                            node;
+
+    // Binding of the node the client was created for, see smu_queue_gen.
+    u32                            gen;
+
+    // Protects the completion list and pending counter.
+    spinlock_t                     lock;
+    struct list_head               completed;
+
+    // Amount of requests submitted which were not yet popped from the completion list.
+    u32                            pending;
+
+    wait_queue_head_t              wait;
+};
+
+struct smu_queue_entry {
+    struct work_struct             work;
+    struct list_head               node;
+
+    struct smu_queue_client*       client;
+    struct ryzen_smu_request       req;
+};
+
+// Each mailbox executes a single command at a time so an ordered queue per mailbox keeps
+//  submissions in order while allowing both mailboxes, and the mailboxes of every node, to be
+//  used simultaneously.
+static struct workqueue_struct* smu_queue_wq[SMU_MAX_NODES][MAILBOX_TYPE_COUNT] = { { NULL } };
+
+// Incremented every time the workqueues of a node are destroyed. Clients created for a previous
+//  binding of the node refer to a device which may no longer exist and are refused.
+static u32 smu_queue_gen[SMU_MAX_NODES] = { 0 };
+
+// Held for reading while submitting or looking up a node, for writing while a node goes away.
+static DECLARE_RWSEM(smu_queue_rwsem);
+
+// Synchronous commands executing on each node, which keep it from going away until they complete
+//  without holding up every other node.
+static atomic_t smu_queue_users[SMU_MAX_NODES];
+static DECLARE_WAIT_QUEUE_HEAD(smu_queue_users_wait);
+
+int smu_queue_init(u32 node) {
+    if (node >= SMU_MAX_NODES)
+        return -EINVAL;
+
+    // Consider it initialized in case it is called twice.
+    if (smu_queue_wq[node][MAILBOX_TYPE_RSMU])
+        return 0;
+
+    smu_queue_wq[node][MAILBOX_TYPE_RSMU] = alloc_ordered_workqueue("ryzen_smu%u_rsmu", 0, node);
+    smu_queue_wq[node][MAILBOX_TYPE_MP1] = alloc_ordered_workqueue("ryzen_smu%u_mp1", 0, node);
+
+    if (!smu_queue_wq[node][MAILBOX_TYPE_RSMU] || !smu_queue_wq[node][MAILBOX_TYPE_MP1]) {
+        smu_queue_cleanup(node);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void smu_queue_cleanup(u32 node) {
+    struct workqueue_struct* wq[MAILBOX_TYPE_COUNT];
+    int i;
+
+    if (node >= SMU_MAX_NODES)
+        return;
+
+    // Waits for synchronous commands and submissions in progress, refusing any after them.
+    down_write(&smu_queue_rwsem);
+
+    for (i = 0; i < MAILBOX_TYPE_COUNT; i++) {
+        wq[i] = smu_queue_wq[node][i];
+        smu_queue_wq[node][i] = NULL;
+    }
+
+    smu_queue_gen[node]++;
+
+    up_write(&smu_queue_rwsem);
+
+    wait_event(smu_queue_users_wait, !atomic_read(&smu_queue_users[node]));
+
+    // Destroying the queue waits for every queued command to execute.
+    for (i = 0; i < MAILBOX_TYPE_COUNT; i++)
+        if (wq[i])
+            destroy_workqueue(wq[i]);
+}
+
+// Callers must hold smu_queue_rwsem.
+static int smu_queue_client_gone(struct smu_queue_client* client) {
+    return client->gen != smu_queue_gen[client->node] || !smu_queue_wq[client->node][MAILBOX_TYPE_RSMU];
+}
+
+struct smu_queue_client* smu_queue_client_alloc(struct pci_dev* dev, u32 node) {
+    struct smu_queue_client* client;
+
+    client = kzalloc(sizeof(*client), GFP_KERNEL);
+    if (!client)
+        return NULL;
+
+    kref_init(&client->ref);
+    spin_lock_init(&client->lock);
+    INIT_LIST_HEAD(&client->completed);
+    init_waitqueue_head(&client->wait);
+
+    client->dev = dev;
+    client->node = node;
+
+    down_read(&smu_queue_rwsem);
+    client->gen = smu_queue_gen[node];
+    up_read(&smu_queue_rwsem);
+
+    return client;
+}
+
+static void smu_queue_client_release(struct kref* ref) {
+    struct smu_queue_client* client = container_of(ref, struct smu_queue_client, ref);
+    struct smu_queue_entry *entry, *tmp;
+
+    // Completions that were never read back.
+    list_for_each_entry_safe(entry, tmp, &client->completed, node) {
+        list_del(&entry->node);
+        kfree(entry);
+    }
+
+    kfree(client);
+}
+
+void smu_queue_client_put(struct smu_queue_client* client) {
+    kref_put(&client->ref, smu_queue_client_release);
+}
+
+wait_queue_head_t* smu_queue_client_wait(struct smu_queue_client* client) {
+    return &client->wait;
+}
+
+static void smu_queue_execute(struct work_struct* work) {
+    struct smu_queue_entry* entry = container_of(work, struct smu_queue_entry, work);
+    struct smu_queue_client* client = entry->client;
+    smu_req_args_t args;
+
+    memcpy(args.args, entry->req.args, sizeof(args.args));
+
+    entry->req.status = smu_send_command(client->dev, entry->req.op, &args, entry->req.mailbox);
+
+    memcpy(entry->req.args, args.args, sizeof(args.args));
+
+    spin_lock(&client->lock);
+    list_add_tail(&entry->node, &client->completed);
+    spin_unlock(&client->lock);
+
+    wake_up_interruptible(&client->wait);
+
+    // Drop the reference taken upon submission.
+    smu_queue_client_put(client);
+}
+
+int smu_queue_submit(struct smu_queue_client* client, const struct ryzen_smu_request* req) {
+    struct smu_queue_entry* entry;
+    int err;
+
+    if (req->mailbox >= MAILBOX_TYPE_COUNT)
+        return -EINVAL;
+
+    spin_lock(&client->lock);
+    if (client->pending >= RYZEN_SMU_QUEUE_MAX_PENDING) {
+        spin_unlock(&client->lock);
+        return -EAGAIN;
+    }
+    client->pending++;
+    spin_unlock(&client->lock);
+
+    entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+    if (!entry) {
+        err = -ENOMEM;
+        goto BREAK_OUT;
+    }
+
+    INIT_WORK(&entry->work, smu_queue_execute);
+    INIT_LIST_HEAD(&entry->node);
+
+    entry->client = client;
+    entry->req = *req;
+    entry->req.status = 0;
+
+    down_read(&smu_queue_rwsem);
+
+    // The device was unbound while the file was open.
+    if (smu_queue_client_gone(client)) {
+        up_read(&smu_queue_rwsem);
+        kfree(entry);
+        err = -ENODEV;
+        goto BREAK_OUT;
+    }
+
+    // Commands hold a reference to the client so that releasing it doesn't need to wait for them.
+    kref_get(&client->ref);
+    queue_work(smu_queue_wq[client->node][req->mailbox], &entry->work);
+
+    up_read(&smu_queue_rwsem);
+
+    return 0;
+
+BREAK_OUT:
+    spin_lock(&client->lock);
+    client->pending--;
+    spin_unlock(&client->lock);
+
+    return err;
+}
+
+int smu_queue_execute_now(struct smu_queue_client* client, struct ryzen_smu_request* req) {
+    smu_req_args_t args;
+
+    if (req->mailbox >= MAILBOX_TYPE_COUNT)
+        return -EINVAL;
+
+    memcpy(args.args, req->args, sizeof(args.args));
+
+    down_read(&smu_queue_rwsem);
+
+    if (smu_queue_client_gone(client)) {
+        up_read(&smu_queue_rwsem);
+        return -ENODEV;
+    }
+
+    // Keeps the node from being unbound while the command executes, see smu_queue_cleanup().
+    atomic_inc(&smu_queue_users[client->node]);
+
+    up_read(&smu_queue_rwsem);
+
+    // Serialized against queued commands by the mailbox lock of the SMU.
+    req->status = smu_send_command(client->dev, req->op, &args, req->mailbox);
+
+    if (atomic_dec_and_test(&smu_queue_users[client->node]))
+        wake_up(&smu_queue_users_wait);
+
+    memcpy(req->args, args.args, sizeof(args.args));
+
+    return 0;
+}
+
+int smu_queue_pop(struct smu_queue_client* client, struct ryzen_smu_request* req) {
+    struct smu_queue_entry* entry;
+
+    spin_lock(&client->lock);
+
+    entry = list_first_entry_or_null(&client->completed, struct smu_queue_entry, node);
+    if (entry) {
+        list_del(&entry->node);
+        client->pending--;
+    }
+
+    spin_unlock(&client->lock);
+
+    if (!entry)
+        return 0;
+
+    *req = entry->req;
+    kfree(entry);
+
+    // Space for a new submission was made.
+    wake_up_interruptible(&client->wait);
+
+    return 1;
+}
+
+int smu_queue_has_completions(struct smu_queue_client* client) {
+    int ret;
+
+    spin_lock(&client->lock);
+    ret = !list_empty(&client->completed);
+    spin_unlock(&client->lock);
+
+    return ret;
+}
+
+int smu_queue_can_submit(struct smu_queue_client* client) {
+    int ret;
+
+    spin_lock(&client->lock);
+    ret = client->pending < RYZEN_SMU_QUEUE_MAX_PENDING;
+    spin_unlock(&client->lock);
+
+    return ret;
+}
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Asynchronous Command Queue */
+
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#include <linux/pci.h>
+#include <linux/wait.h>
+
+#include "ryzen_smu.h"
+
+/**
+ * Executes SMU commands asynchronously on a workqueue.
+ * Commands sent to the same mailbox are executed in the order they were submitted.
+ * Each client owns a completion list and a wait queue which is woken every time one of its
+ *  commands has completed or space is made for new submissions.
+ */
+struct smu_queue_client;
+
+/**
+ * Allocates or frees the workqueues used to execute commands on the SMU of [node].
+ * Once freed, clients created for the node are refused with -ENODEV, even if it is bound again.
+ *
+ * Returns 0 on success, anything else on failure.
+ */
+int smu_queue_init(u32 node);
+void smu_queue_cleanup(u32 node);
+
+/**
+ * Creates a client submitting commands to the SMU of [dev], bound as [node], or drops a
+ *  reference to it.
+ * The client is freed once it was released and all of its queued commands have completed.
+ *
+ * Returns NULL on failure.
+ */
+struct smu_queue_client* smu_queue_client_alloc(struct pci_dev* dev, u32 node);
+void smu_queue_client_put(struct smu_queue_client* client);
+
+/**
+ * Returns the wait queue of the client, woken upon completions or when space becomes available.
+ */
+wait_queue_head_t* smu_queue_client_wait(struct smu_queue_client* client);
+
+/**
+ * Queues a request for execution.
+ *
+ * Returns 0 on success, -EAGAIN if the client has RYZEN_SMU_QUEUE_MAX_PENDING requests which were
+ *  not yet read back, -EINVAL if the request is invalid, -ENODEV if the SMU was unbound or -ENOMEM.
+ */
+int smu_queue_submit(struct smu_queue_client* client, const struct ryzen_smu_request* req);
+
+/**
+ * Executes a request synchronously on the SMU of the client, without going through its queue,
+ *  filling in its status and args.
+ *
+ * Returns 0 on success, -EINVAL if the request is invalid or -ENODEV if the SMU was unbound.
+ */
+int smu_queue_execute_now(struct smu_queue_client* client, struct ryzen_smu_request* req);
+
+/**
+ * Removes the oldest completed request of the client and stores it in [req].
+ *
+ * Returns 1 if a request was returned, 0 if none have completed.
+ */
+int smu_queue_pop(struct smu_queue_client* client, struct ryzen_smu_request* req);
+
+/**
+ * Returns whether the client has completed requests or may submit new ones, respectively.
+ */
+int smu_queue_has_completions(struct smu_queue_client* client);
+int smu_queue_can_submit(struct smu_queue_client* client);
+
+#endif /* __QUEUE_H__ */
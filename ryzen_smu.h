@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Character Device Interface */
+
+#ifndef __RYZEN_SMU_H__
+#define __RYZEN_SMU_H__
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/**
+ * Definitions shared with userspace for the character devices exposed by the driver.
+ * Everything in here is part of the driver's ABI and must only ever be extended.
+ */
+
+/* Name of the SMU command device, created under /dev. Nodes other than 0 append their number. */
+#define RYZEN_SMU_DEV_NAME                            "ryzen_smu"
+
+/* Name of the SMN access device, created under /dev. Nodes other than 0 append their number. */
+#define RYZEN_SMN_DEV_NAME                            "ryzen_smn"
+
+/* Name of the PM table snapshot device, created under /dev like the above. */
+#define RYZEN_SMU_PM_DEV_NAME                         "ryzen_smu_pm"
+
+/* Name of the PM table access device, created under /dev like the above. */
+#define RYZEN_SMU_PM_TABLE_DEV_NAME                   "ryzen_smu_pm_table"
+
+/* Maximum number of requests a single open file may have queued but not yet read back. */
+#define RYZEN_SMU_QUEUE_MAX_PENDING                   64
+
+/**
+ * Asynchronous SMU Service Request
+ *
+ * Written to /dev/ryzen_smu to queue a command and read back from it once the command has
+ *  completed. Any amount of requests may be written or read in a single call.
+ */
+struct ryzen_smu_request {
+    /* Opaque value returned as-is upon completion, used to match requests to completions. */
+    __u64                      tag;
+
+    /* Target mailbox, see enum smu_mailbox. */
+    __u32                      mailbox;
+    __u32                      op;
+
+    /* Arguments of the command which are replaced by the response upon success. */
+    __u32                      args[6];
+
+    /* smu_return_val indicating the status of the command, set upon completion. */
+    __u32                      status;
+    __u32                      reserved;
+};
+
+/* Maximum number of accesses a single SMN batch may contain. */
+#define RYZEN_SMN_BATCH_MAX                           256
+
+/**
+ * Single SMN Access
+ */
+struct ryzen_smn_op {
+    __u32                      address;
+
+    /* Value to write or, for reads, the value read. */
+    __u32                      value;
+
+    /* Non-zero for writes, zero for reads. */
+    __u32                      write;
+
+    /* smu_return_val indicating the status of the access. */
+    __u32                      status;
+};
+
+/**
+ * Batch of SMN accesses executed in order in a single call.
+ */
+struct ryzen_smn_batch {
+    /* Userspace pointer to an array of [count] struct ryzen_smn_op. */
+    __u64                      ops;
+    __u32                      count;
+    __u32                      reserved;
+};
+
+/* Size of the mapping of /dev/ryzen_smu_pm and offset of the PM table within it. */
+#define RYZEN_SMU_PM_MAP_SIZE                         8192
+#define RYZEN_SMU_PM_DATA_OFFSET                      64
+
+/**
+ * PM Table Snapshot Header
+ *
+ * Placed at the start of the read-only mapping of /dev/ryzen_smu_pm, followed by the PM table at
+ *  data_offset. The snapshot is updated in place, so readers take a consistent view as follows:
+ *
+ *   1. Read seq, retrying while it is odd as an update is in progress.
+ *   2. Copy the fields and table needed, with a read barrier before and after.
+ *   3. Read seq again and start over if it changed.
+ */
+struct ryzen_smu_pm_header {
+    /* Odd while the snapshot is being updated, incremented by two for every update. */
+    __u32                      seq;
+
+    /* Size in bytes of the PM table, zero until it was successfully read for the first time. */
+    __u32                      size;
+
+    /* Version of the PM table, zero if it doesn't have one. */
+    __u32                      version;
+
+    /* Offset of the PM table from the start of the mapping. */
+    __u32                      data_offset;
+
+    /* CLOCK_MONOTONIC time, in nanoseconds, at which the SMU was commanded to transfer the table. */
+    __u64                      timestamp_ns;
+
+    __u64                      reserved[5];
+};
+
+/**
+ * PM Table History Entry
+ *
+ * Every refresh of the snapshot is recorded in a history, when enabled through the pm_history_len
+ *  module parameter. Entries are drained in bulk, each followed by [size] bytes of the table and
+ *  padded to the stride reported by the drain.
+ */
+struct ryzen_smu_pm_sample {
+    /* Sequence number of the refresh, starting from zero. */
+    __u64                      seq;
+
+    /* CLOCK_MONOTONIC time, in nanoseconds, at which the SMU was commanded to transfer the table. */
+    __u64                      timestamp_ns;
+
+    __u32                      size;
+    __u32                      reserved;
+};
+
+/**
+ * PM Table History Delta
+ *
+ * Entry of the history as stored by RYZEN_SMU_PM_IOC_DRAIN_DELTA, followed by [size] bytes holding
+ *  either the whole table or a struct ryzen_smu_pm_delta_word for every 32-bit word of the table
+ *  which changed since the previous entry of the drain. The first entry of a drain and every entry
+ *  following lost ones hold the whole table, so a drain can always be decoded on its own.
+ */
+struct ryzen_smu_pm_delta {
+    /* Sequence number of the refresh, starting from zero. */
+    __u64                      seq;
+
+    /* CLOCK_MONOTONIC time, in nanoseconds, at which the SMU was commanded to transfer the table. */
+    __u64                      timestamp_ns;
+
+    /* Size in bytes of what follows the header, the next entry starting right after it. */
+    __u32                      size;
+
+    /* RYZEN_SMU_PM_DELTA_FULL if the whole table follows, padded to a multiple of 8 bytes. */
+    __u32                      flags;
+};
+
+#define RYZEN_SMU_PM_DELTA_FULL                       0x1
+
+struct ryzen_smu_pm_delta_word {
+    /* Offset in bytes of the word within the table and its new value. */
+    __u32                      offset;
+    __u32                      value;
+};
+
+/**
+ * Drains the PM table history into a buffer.
+ */
+struct ryzen_smu_pm_drain {
+    /* In: sequence number of the first entry wanted. Out: cursor to pass to the next drain. */
+    __u64                      seq;
+
+    /* Userspace pointer to a buffer of [size] bytes receiving the entries. */
+    __u64                      buf;
+    __u32                      size;
+
+    /* Out: amount of entries stored and the distance between them, or for delta drains the amount
+     *  of bytes stored, as their entries vary in size. */
+    __u32                      count;
+    union {
+        __u32                  stride;
+        __u32                  used;
+    };
+
+    /* Out: amount of entries which were overwritten before they could be drained. */
+    __u32                      lost;
+};
+
+/**
+ * Occupancy of the PM table history. The history is compressed, so the amount of samples it holds
+ *  depends on how much the table changes between them rather than on pm_history_len alone.
+ */
+struct ryzen_smu_pm_history {
+    /* Sequence numbers of the oldest sample held and of the next one recorded. */
+    __u64                      oldest_seq;
+    __u64                      next_seq;
+
+    /* Bytes reserved for the history and bytes holding samples. */
+    __u64                      size;
+    __u64                      used;
+};
+
+#define RYZEN_SMU_IOC_MAGIC                           0xB5
+
+/* Executes a struct ryzen_smn_batch on /dev/ryzen_smn. */
+#define RYZEN_SMN_IOC_BATCH                           _IOWR(RYZEN_SMU_IOC_MAGIC, 0x01, struct ryzen_smn_batch)
+
+/**
+ * Executes a struct ryzen_smu_request on /dev/ryzen_smu synchronously, returning once the status
+ *  and args fields were filled in. The tag is left as-is and the request bypasses the queue of the
+ *  file, so it isn't ordered against requests queued through write().
+ */
+#define RYZEN_SMU_IOC_COMMAND                         _IOWR(RYZEN_SMU_IOC_MAGIC, 0x02, struct ryzen_smu_request)
+
+/* Refreshes the snapshot of /dev/ryzen_smu_pm from the SMU. */
+#define RYZEN_SMU_PM_IOC_REFRESH                      _IO(RYZEN_SMU_IOC_MAGIC, 0x10)
+
+/* Copies entries of the history of /dev/ryzen_smu_pm, see struct ryzen_smu_pm_drain. */
+#define RYZEN_SMU_PM_IOC_DRAIN                        _IOWR(RYZEN_SMU_IOC_MAGIC, 0x11, struct ryzen_smu_pm_drain)
+
+/**
+ * Copies entries of the history of /dev/ryzen_smu_pm as struct ryzen_smu_pm_delta, holding only the
+ *  words which changed between them. The buffer must hold at least one entry with the whole table.
+ */
+#define RYZEN_SMU_PM_IOC_DRAIN_DELTA                  _IOWR(RYZEN_SMU_IOC_MAGIC, 0x13, struct ryzen_smu_pm_drain)
+
+/**
+ * Sets the age, in microseconds, of the PM table that RYZEN_SMU_PM_IOC_REFRESH accepts through
+ *  this file rather than having the SMU refresh it. 0 always refreshes the table, unless another
+ *  refresh completed while waiting for it, RYZEN_SMU_PM_MAX_AGE_DEFAULT uses the module parameter
+ *  pm_refresh_interval_us and is the default.
+ */
+#define RYZEN_SMU_PM_IOC_SET_MAX_AGE                  _IOW(RYZEN_SMU_IOC_MAGIC, 0x12, __u32)
+
+/* Reports the occupancy of the history of /dev/ryzen_smu_pm, see struct ryzen_smu_pm_history. */
+#define RYZEN_SMU_PM_IOC_HISTORY_INFO                 _IOR(RYZEN_SMU_IOC_MAGIC, 0x14, struct ryzen_smu_pm_history)
+
+#define RYZEN_SMU_PM_MAX_AGE_DEFAULT                  0xFFFFFFFF
+
+#endif /* __RYZEN_SMU_H__ */
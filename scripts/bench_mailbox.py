@@ -0,0 +1,149 @@
+#!/bin/python3
+
+# Measures the latency of MP1 commands while the RSMU mailbox is idle and while it is kept busy
+#  transferring the PM table, showing how much MP1 clients are held up by RSMU traffic.
+
+import os
+import sys
+import time
+import struct
+import threading
+
+FS_PATH  = '/sys/kernel/ryzen_smu_drv/'
+VER_PATH = FS_PATH + 'version'
+CN_PATH  = FS_PATH + 'codename'
+DEV_PATH = '/dev/ryzen_smu'
+
+MAILBOX_RSMU = 0
+MAILBOX_MP1  = 1
+
+# struct ryzen_smu_request: tag, mailbox, op, args[6], status, reserved
+REQ_FORMAT = "<QII6III"
+REQ_SIZE   = struct.calcsize(REQ_FORMAT)
+
+DURATION = 5
+
+def is_root():
+    return os.getenv("SUDO_USER") is not None or os.geteuid() == 0
+
+def driver_loaded():
+    return os.path.isfile(VER_PATH) and os.path.exists(DEV_PATH)
+
+def read_file_str(file, expectedLen = 3):
+    with open(file, "r") as fp:
+        result = fp.read(expectedLen)
+        fp.close()
+
+    return result
+
+def getTransferCommand():
+    # [op, arg0] of TransferTableSmu2Dram per codename, see smu_transfer_table_to_dram().
+    commands = {
+        2:  [0x65, 3], # Renoir
+        3:  [0x3d, 3], # Picasso
+        4:  [0x05, 0], # Matisse
+        7:  [0x3d, 3], # Raven Ridge
+        8:  [0x3d, 3], # Raven Ridge 2
+        12: [0x05, 0], # Vermeer
+        14: [0x65, 0], # Cezanne
+        15: [0x05, 0], # Milan
+    }
+
+    return commands.get(int(read_file_str(CN_PATH)), False)
+
+# Returns the status and first argument of the response.
+def smu_command(fd, mailbox, op, arg0 = 0):
+    os.write(fd, struct.pack(REQ_FORMAT, 0, mailbox, op, arg0, 0, 0, 0, 0, 0, 0, 0))
+    resp = struct.unpack(REQ_FORMAT, os.read(fd, REQ_SIZE))
+    return resp[9], resp[3]
+
+def mp1_client(results, stop):
+    fd = os.open(DEV_PATH, os.O_RDWR)
+
+    arg = 0
+
+    while not stop.is_set():
+        start = time.perf_counter_ns()
+
+        # TestMessage, which answers with its argument plus one. Unlike GetSMUVersion, the driver
+        #  never answers it from its cache of command results, so every call reaches the SMU.
+        arg = (arg + 1) & 0xFFFF
+        status, resp = smu_command(fd, MAILBOX_MP1, 0x01, arg)
+
+        if status != 1 or resp != arg + 1:
+            print("MP1 command failed!")
+            break
+
+        results.append(time.perf_counter_ns() - start)
+
+    os.close(fd)
+
+def rsmu_client(command, counter, stop):
+    fd = os.open(DEV_PATH, os.O_RDWR)
+
+    while not stop.is_set():
+        if smu_command(fd, MAILBOX_RSMU, command[0], command[1])[0] != 1:
+            print("RSMU command failed!")
+            break
+
+        counter[0] = counter[0] + 1
+
+    os.close(fd)
+
+def run(command):
+    results = []
+    counter = [0]
+    stop = threading.Event()
+
+    threads = [threading.Thread(target = mp1_client, args = (results, stop))]
+    if command != False:
+        threads.append(threading.Thread(target = rsmu_client, args = (command, counter, stop)))
+
+    for t in threads:
+        t.start()
+
+    time.sleep(DURATION)
+    stop.set()
+
+    for t in threads:
+        t.join()
+
+    return sorted(results), counter[0]
+
+def report(label, results, rsmu_count):
+    if len(results) == 0:
+        print("{0}: no MP1 commands completed".format(label))
+        return
+
+    print("{0}: {1:d} MP1 commands ({2:.0f}/s), p50 {3:.1f} us, p99 {4:.1f} us, max {5:.1f} us, {6:d} RSMU transfers".format(
+        label,
+        len(results),
+        len(results) / DURATION,
+        results[len(results) // 2] / 1000,
+        results[len(results) * 99 // 100] / 1000,
+        results[-1] / 1000,
+        rsmu_count))
+
+def main():
+    if is_root() == False:
+        print("Script must be run as root.")
+        exit(1)
+
+    if driver_loaded() == False:
+        print("The driver does not seem to be loaded.")
+        exit(2)
+
+    command = getTransferCommand()
+    if command == False:
+        print("PM table transfers are not supported on this processor.")
+        exit(3)
+
+    print("Running each scenario for {:d} seconds ...".format(DURATION))
+
+    results, count = run(False)
+    report("MP1 only   ", results, count)
+
+    results, count = run(command)
+    report("MP1 + RSMU ", results, count)
+
+main()
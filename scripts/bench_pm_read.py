@@ -0,0 +1,71 @@
+#!/bin/python3
+
+# Compares reading the whole PM table through sysfs and /dev/ryzen_smu_pm_table with reading only
+#  a few fields at an offset through the latter, as most monitoring agents do.
+
+import os
+import time
+
+FS_PATH  = '/sys/kernel/ryzen_smu_drv/'
+VER_PATH = FS_PATH + 'version'
+PM_PATH  = FS_PATH + 'pm_table'
+DEV_PATH = '/dev/ryzen_smu_pm_table'
+
+DURATION = 3
+
+# 16 floats starting at the PPT limit and value.
+FIELDS_OFFSET = 0x00
+FIELDS_SIZE   = 16 * 4
+
+def is_root():
+    return os.getenv("SUDO_USER") is not None or os.geteuid() == 0
+
+def driver_loaded():
+    return os.path.isfile(VER_PATH) and os.path.exists(DEV_PATH)
+
+def run(read):
+    count = 0
+    start = time.perf_counter()
+    end = start + DURATION
+
+    while time.perf_counter() < end:
+        read()
+        count = count + 1
+
+    return count / (time.perf_counter() - start)
+
+def report(label, rate, size):
+    print("{0}: {1:9.0f} reads/s, {2:6.2f} us/read, {3:7.1f} MB/s".format(
+        label, rate, 1e6 / rate, rate * size / 1e6))
+
+def main():
+    if is_root() == False:
+        print("Script must be run as root.")
+        exit(1)
+
+    if driver_loaded() == False:
+        print("The driver does not seem to be loaded or the PM table is not supported.")
+        exit(2)
+
+    fd = os.open(PM_PATH, os.O_RDONLY)
+    size = len(os.pread(fd, 0x2000, 0))
+    os.close(fd)
+
+    print("PM table size: {:d} bytes, running each scenario for {:d} seconds ...".format(size, DURATION))
+
+    # sysfs attributes have to be reopened for every read.
+    def sysfs_full():
+        fd = os.open(PM_PATH, os.O_RDONLY)
+        os.read(fd, size)
+        os.close(fd)
+
+    fd = os.open(DEV_PATH, os.O_RDONLY)
+
+    report("sysfs, full      ", run(sysfs_full), size)
+    report("device, full     ", run(lambda: os.pread(fd, size, 0)), size)
+    report("device, {:3d} bytes".format(FIELDS_SIZE),
+        run(lambda: os.pread(fd, FIELDS_SIZE, FIELDS_OFFSET)), FIELDS_SIZE)
+
+    os.close(fd)
+
+main()
@@ -0,0 +1,102 @@
+#!/bin/python3
+
+# Measures the rate at which concurrent readers can access the SMN through /dev/ryzen_smn while the
+#  driver spreads accesses across 1 and 2 PCI index/data register pairs, and 3 with --lane3.
+#
+# The third pair (0x60/0x64) is also used by k10temp and amd_nb without any lock shared with the
+#  driver, so it is only tested when asked for. smn_lanes is restored once done.
+
+import os
+import sys
+import time
+import threading
+
+FS_PATH    = '/sys/kernel/ryzen_smu_drv/'
+VER_PATH   = FS_PATH + 'version'
+DEV_PATH   = '/dev/ryzen_smn'
+LANES_PATH = '/sys/module/ryzen_smu/parameters/smn_lanes'
+
+# THM_TCON_CUR_TMP, present on every supported processor.
+SMN_ADDRESS = 0x00059800
+
+THREADS  = 4
+DURATION = 3
+
+def is_root():
+    return os.getenv("SUDO_USER") is not None or os.geteuid() == 0
+
+def driver_loaded():
+    return os.path.isfile(VER_PATH) and os.path.exists(DEV_PATH) and os.path.isfile(LANES_PATH)
+
+def read_file_str(file):
+    with open(file, "r") as fp:
+        result = fp.read().strip()
+        fp.close()
+
+    return result
+
+def write_file_str(file, value):
+    with open(file, "w") as fp:
+        fp.write(value)
+        fp.close()
+
+def reader(counter, index, stop):
+    fd = os.open(DEV_PATH, os.O_RDONLY)
+
+    while not stop.is_set():
+        if len(os.pread(fd, 4, SMN_ADDRESS)) != 4:
+            print("SMN read failed!")
+            break
+
+        counter[index] = counter[index] + 1
+
+    os.close(fd)
+
+def run(lanes):
+    counter = [0] * THREADS
+    stop = threading.Event()
+
+    write_file_str(LANES_PATH, str(lanes))
+
+    threads = [threading.Thread(target = reader, args = (counter, i, stop)) for i in range(THREADS)]
+
+    for t in threads:
+        t.start()
+
+    time.sleep(DURATION)
+    stop.set()
+
+    for t in threads:
+        t.join()
+
+    return sum(counter)
+
+def main():
+    if is_root() == False:
+        print("Script must be run as root.")
+        exit(1)
+
+    if driver_loaded() == False:
+        print("The driver does not seem to be loaded.")
+        exit(2)
+
+    settings = [1, 2]
+
+    if "--lane3" in sys.argv[1:]:
+        print("Testing the 0x60/0x64 pair, which races k10temp and amd_nb while in use.")
+        settings.append(3)
+
+    original = read_file_str(LANES_PATH)
+
+    print("Running {:d} readers for {:d} seconds per setting ...".format(THREADS, DURATION))
+
+    try:
+        for lanes in settings:
+            count = run(lanes)
+            print("{0:d} lane(s): {1:d} accesses ({2:.0f}/s)".format(lanes, count, count / DURATION))
+    finally:
+        write_file_str(LANES_PATH, original)
+
+    print("smn_lanes was restored to {0}. Lanes which failed their probe on first use are not used, see dmesg.".format(original))
+
+main()
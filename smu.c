@@ -5,10 +5,94 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/time.h>
+#include <linux/ktime.h>
 #include <linux/pci.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
 #include <asm/io.h>
+#ifdef CONFIG_X86
+#include <asm/cacheflush.h>
+#endif
 
 #include "smu.h"
+#include "stats.h"
+
+#define CREATE_TRACE_POINTS
+#include "smu_trace.h"
+
+/**
+ * Describes the amount of argument registers a command reads from and writes to, allowing the
+ *  remaining registers to be skipped when executing it.
+ * Commands without a descriptor access all SMU_REQ_MAX_ARGS registers.
+ *
+ * Getters returning values that can't change while the system is running may additionally have
+ *  their results cached, keyed by their arguments, for cache_ttl_ms milliseconds or forever.
+ * Setters changing what a getter returns list the cache group of the getter in cache_invalidates.
+ */
+struct smu_cmd_desc {
+    u32                            op;
+    u8                             args_in;
+    u8                             args_out;
+    u16                            cache_ttl_ms;
+    u8                             cache_group;
+    u8                             cache_invalidates;
+};
+
+#define SMU_CACHE_FOREVER                  U16_MAX
+
+// Cache groups of getters which are affected by setters.
+#define SMU_CACHE_GROUP_OC                 BIT(0)
+#define SMU_CACHE_GROUP_PBO                BIT(1)
+
+// Commands that are valid on both mailboxes of every processor.
+static const struct smu_cmd_desc smu_cmds_global[] = {
+    { 0x01, 1, 1 },                                     // TestMessage
+    { 0x02, 1, 1, SMU_CACHE_FOREVER },                  // GetSMUVersion
+};
+
+// See docs/rsmu_commands.md.
+static const struct smu_cmd_desc smu_rsmu_cmds_matisse[] = {
+    { 0x05, 1, 0 },                                     // TransferTableSmu2Dram
+    { 0x06, 2, 2, SMU_CACHE_FOREVER },                  // GetDramBaseAddress
+    { 0x08, 0, 1, SMU_CACHE_FOREVER },                  // GetPMTableVersion
+    { 0x14, 1, 0 },                                     // SetVDDCRSoC
+    { 0x53, 1, 0 },                                     // SetPPTLimit
+    { 0x54, 1, 0 },                                     // SetTDCLimit
+    { 0x55, 1, 0 },                                     // SetEDCLimit
+    { 0x56, 1, 0 },                                     // SetcHTCLimit
+    { 0x58, 1, 0, 0, 0, SMU_CACHE_GROUP_PBO },          // SetPBOScalar
+    { 0x59, 0, 1, SMU_CACHE_FOREVER },                  // GetFastestCoreOfSocket
+    { 0x5A, 1, 0, 0, 0, SMU_CACHE_GROUP_OC },           // SetPROCHOTStatus/EnableOverclocking
+    { 0x5B, 1, 0, 0, 0, SMU_CACHE_GROUP_OC },           // DisableOverclocking
+    { 0x5C, 1, 0, 0, 0, SMU_CACHE_GROUP_OC },           // SetOverclockFreqAllCores
+    { 0x5D, 1, 0, 0, 0, SMU_CACHE_GROUP_OC },           // SetOverclockFreqPerCore
+    { 0x61, 1, 0 },                                     // SetOverclockCPUVID
+    { 0x6C, 0, 1, SMU_CACHE_FOREVER, SMU_CACHE_GROUP_PBO }, // GetPBOScalar
+    // Commands other tools may send through unknown IDs could affect this, so it expires.
+    { 0x6E, 0, 1, 1000, SMU_CACHE_GROUP_OC },           // GetMaxFrequency
+    { 0x6F, 0, 1, SMU_CACHE_FOREVER },                  // GetProcessorParameters
+};
+
+// Only the commands used by the driver are known for these.
+static const struct smu_cmd_desc smu_rsmu_cmds_castlepeak[] = {
+    { 0x05, 1, 0 },                                     // TransferTableSmu2Dram
+    { 0x06, 2, 2, SMU_CACHE_FOREVER },                  // GetDramBaseAddress
+    { 0x08, 0, 1, SMU_CACHE_FOREVER },                  // GetPMTableVersion
+};
+
+static const struct smu_cmd_desc smu_rsmu_cmds_renoir[] = {
+    { 0x06, 0, 1, SMU_CACHE_FOREVER },                  // GetPMTableVersion
+    { 0x65, 1, 0 },                                     // TransferTableSmu2Dram
+    { 0x66, 2, 2, SMU_CACHE_FOREVER },                  // GetDramBaseAddress
+};
+
+// The DRAM base is read through a selector, so its commands can't be cached.
+static const struct smu_cmd_desc smu_rsmu_cmds_picasso[] = {
+    { 0x0A, 1, 0 },                                     // GetDramBaseAddress (Select)
+    { 0x0B, 1, 1 },                                     // GetDramBaseAddress (Read)
+    { 0x0C, 0, 1, SMU_CACHE_FOREVER },                  // GetPMTableVersion
+    { 0x3D, 1, 0 },                                     // TransferTableSmu2Dram
+};
 
 static struct {
     enum smu_processor_codename    codename;
@@ -18,11 +102,112 @@ static struct {
     u32                            addr_rsmu_mb_rsp;
     u32                            addr_rsmu_mb_args;
 
+    // Descriptors of the known RSMU commands for the running processor.
+    const struct smu_cmd_desc*     rsmu_cmds;
+    u32                            rsmu_cmds_count;
+
     // Mandatory MP1 mailbox addresses.
     enum smu_if_version            mp1_if_ver;
     u32                            addr_mp1_mb_cmd;
     u32                            addr_mp1_mb_rsp;
     u32                            addr_mp1_mb_args;
+} g_smu = {
+    .codename                    = CODENAME_UNDEFINED,
+
+    .addr_rsmu_mb_cmd            = 0,
+    .addr_rsmu_mb_rsp            = 0,
+    .addr_rsmu_mb_args           = 0,
+
+    .rsmu_cmds                   = NULL,
+    .rsmu_cmds_count             = 0,
+
+    .mp1_if_ver                  = IF_VERSION_COUNT,
+    .addr_mp1_mb_cmd             = 0,
+    .addr_mp1_mb_rsp             = 0,
+    .addr_mp1_mb_args            = 0,
+};
+
+/**
+ * An index/data register pair of the root complex through which the SMN can be accessed.
+ * Each pair is a separate window into the SMN, so accesses through different pairs only need to
+ *  be serialized against accesses through the same pair.
+ */
+struct smu_smn_lane {
+    u32                            addr_reg;
+    u32                            data_reg;
+    struct mutex                   lock;
+};
+
+// Index/data registers of each lane, in order of preference.
+static const u32 smu_smn_lane_regs[SMU_SMN_LANES_MAX][2] = {
+    { SMU_PCI_ADDR_REG,      SMU_PCI_DATA_REG      },
+    { SMU_PCI_ADDR_REG_ALT1, SMU_PCI_DATA_REG_ALT1 },
+    { SMU_PCI_ADDR_REG_ALT2, SMU_PCI_DATA_REG_ALT2 },
+};
+
+/**
+ * Cached result of a getter command.
+ */
+struct smu_cache_entry {
+    bool                           valid;
+    u8                             mailbox;
+    u8                             group;
+    u32                            op;
+
+    // Arguments the command was sent with and the results it returned.
+    u32                            args[SMU_REQ_MAX_ARGS];
+    u32                            results[SMU_REQ_MAX_ARGS];
+
+    // Zero for entries that never expire.
+    ktime_t                        expires;
+};
+
+/* Number of getter results cached per SMU, replaced round-robin once full. */
+#define SMU_CACHE_ENTRIES                  16
+
+/**
+ * State of the SMU behind a single root complex.
+ * Every SMU in the system runs the same firmware so the mailbox layout in g_smu is shared, but
+ *  each has its own mailboxes, SMN windows and PM table, which are used independently.
+ */
+struct smu_instance {
+    // Cleared, under every lock of the instance, once the device is torn down.
+    struct pci_dev*                dev;
+
+    // Whether the locks were initialized. They are kept when the slot is reused for another
+    //  device, as callers that looked the instance up before it was torn down may be waiting on
+    //  them.
+    bool                           initialized;
+
+    // The SMN locks are separate from the mailbox locks because the SMN address space can be
+    //  used independently from the SMU but the SMU requires access to the SMN to execute commands.
+    // The RSMU and MP1 mailboxes use disjoint registers, so each has its own lock, allowing a
+    //  command to be executed on one while a slow command is in flight on the other.
+    struct mutex                   rsmu_lock;
+    struct mutex                   mp1_lock;
+
+    struct smu_smn_lane            lanes[SMU_SMN_LANES_MAX];
+
+    // Lane to start looking for an idle lane from, rotated on every acquisition.
+    atomic_t                       lane_next;
+
+    // Getter results, see struct smu_cmd_desc.
+    spinlock_t                     cache_lock;
+    struct smu_cache_entry         cache[SMU_CACHE_ENTRIES];
+    u32                            cache_next;
+
+    // Amount of SMN lanes that were verified to work, the first of which is always usable.
+    u32                            smn_lanes_valid;
+
+    // Amount of SMN lanes that were probed so far, serialized by lanes_probe_lock.
+    u32                            smn_lanes_probed;
+    struct mutex                   lanes_probe_lock;
+
+    // Serializes PM table refreshes and copies so that concurrent readers share a single refresh.
+    struct mutex                   pm_lock;
+
+    // Incremented, under pm_lock, every time the SMU has refreshed the PM table.
+    u32                            pm_generation;
 
     // Optional PM table information.
     u64                            pm_dram_base;
@@ -30,52 +215,107 @@ static struct {
     u32                            pm_dram_map_size;
     u32                            pm_dram_map_size_alt;
 
-    // Internal tracker to determine the minimum interval required to
-    //  refresh the metrics table.
-    u32                            pm_jiffies;
+    // Time at which the SMU was last commanded to refresh the PM table, 0 if it never was.
+    ktime_t                        pm_refreshed;
 
     // Virtual addresses mapped to physical DRAM bases for PM table.
     u8 __iomem*                    pm_table_virt_addr;
     u8 __iomem*                    pm_table_virt_addr_alt;
-} g_smu = {
-    .codename                    = CODENAME_UNDEFINED,
+};
 
-    .addr_rsmu_mb_cmd            = 0,
-    .addr_rsmu_mb_rsp            = 0,
-    .addr_rsmu_mb_args           = 0,
+static struct smu_instance g_smu_instances[SMU_MAX_NODES];
 
-    .mp1_if_ver                  = IF_VERSION_COUNT,
-    .addr_mp1_mb_cmd             = 0,
-    .addr_mp1_mb_rsp             = 0,
-    .addr_mp1_mb_args            = 0,
+// Serializes creating and destroying instances as well as resolving g_smu.
+static DEFINE_MUTEX(smu_instances_mutex);
 
-    .pm_dram_base                = 0,
-    .pm_dram_base_alt            = 0,
-    .pm_dram_map_size            = 0,
-    .pm_dram_map_size_alt        = 0,
-    .pm_jiffies                  = 0,
+/**
+ * Returns the instance of [dev] or NULL if smu_init() wasn't called for it.
+ * Instances are only published once fully initialized, but may be torn down at any time after
+ *  being looked up, so smu_instance_gone() must be checked once a lock of the instance is held.
+ */
+static struct smu_instance* smu_get_instance(struct pci_dev* dev) {
+    u32 i;
 
-    .pm_table_virt_addr          = NULL,
-    .pm_table_virt_addr_alt      = NULL,
-};
+    if (!dev)
+        return NULL;
 
-// Both mutexes are defined separately because the SMN address space can be used
-//  independently from the SMU but the SMU requires access to the SMN to execute commands.
-static DEFINE_MUTEX(amd_pci_mutex);
-static DEFINE_MUTEX(amd_smu_mutex);
+    for (i = 0; i < SMU_MAX_NODES; i++)
+        if (READ_ONCE(g_smu_instances[i].dev) == dev)
+            return &g_smu_instances[i];
 
-int smu_smn_rw_address(struct pci_dev* dev, u32 address, u32* value, int write) {
+    return NULL;
+}
+
+/**
+ * Returns whether [inst] was torn down, or reused for another device, since it was looked up for
+ *  [dev], in which case none of its mappings may be used anymore.
+ * Callers must hold one of the locks of the instance.
+ */
+static bool smu_instance_gone(struct smu_instance* inst, struct pci_dev* dev) {
+    return READ_ONCE(inst->dev) != dev;
+}
+
+static void smu_smn_lanes_probe(struct pci_dev* dev, struct smu_instance* inst, u32 count);
+
+/**
+ * Locks and returns an SMN lane of the instance, preferring one that is currently idle.
+ * Lanes newly allowed by smn_lanes are probed before their first use.
+ *
+ * Returns NULL if the instance is gone.
+ */
+static struct smu_smn_lane* smu_smn_lane_lock(struct smu_instance* inst, struct pci_dev* dev) {
+    struct smu_smn_lane* lane;
+    u32 i, start, count;
+
+    count = clamp_val(READ_ONCE(smn_lanes), 1, SMU_SMN_LANES_MAX);
+    if (count > READ_ONCE(inst->smn_lanes_probed) && !smu_instance_gone(inst, dev))
+        smu_smn_lanes_probe(dev, inst, count);
+
+    count = min(count, READ_ONCE(inst->smn_lanes_valid));
+    if (count == 1) {
+        lane = &inst->lanes[0];
+        mutex_lock(&lane->lock);
+        goto CHECK_GONE;
+    }
+
+    start = (u32)atomic_inc_return(&inst->lane_next) % count;
+
+    for (i = 0; i < count; i++) {
+        lane = &inst->lanes[(start + i) % count];
+
+        if (mutex_trylock(&lane->lock))
+            goto CHECK_GONE;
+    }
+
+    // All lanes are busy, queue up on the one this acquisition was assigned.
+    lane = &inst->lanes[start];
+    mutex_lock(&lane->lock);
+
+CHECK_GONE:
+    if (smu_instance_gone(inst, dev)) {
+        mutex_unlock(&lane->lock);
+        return NULL;
+    }
+
+    return lane;
+}
+
+static void smu_smn_lane_unlock(struct smu_smn_lane* lane) {
+    mutex_unlock(&lane->lock);
+}
+
+// Callers must hold the lock of the lane.
+static int smu_smn_rw_address_locked(struct pci_dev* dev, struct smu_smn_lane* lane, u32 address,
+    u32* value, int write) {
     int err;
 
-    // This may work differently for multi-NUMA systems.
-    mutex_lock(&amd_pci_mutex);
-    err = pci_write_config_dword(dev, SMU_PCI_ADDR_REG, address);
+    err = pci_write_config_dword(dev, lane->addr_reg, address);
 
     if (!err) {
         err = (
             write ?
-                pci_write_config_dword(dev, SMU_PCI_DATA_REG, *value) :
-                pci_read_config_dword(dev, SMU_PCI_DATA_REG, value)
+                pci_write_config_dword(dev, lane->data_reg, *value) :
+                pci_read_config_dword(dev, lane->data_reg, value)
         );
 
         if (err)
@@ -83,11 +323,136 @@ int smu_smn_rw_address(struct pci_dev* dev, u32 address, u32* value, int write)
     }
     else
         pr_warn("Error programming SMN address: 0x%x!\n", address);
-    mutex_unlock(&amd_pci_mutex);
 
     return err;
 }
 
+int smu_smn_rw_address(struct pci_dev* dev, u32 address, u32* value, int write) {
+    struct smu_instance* inst;
+    struct smu_smn_lane* lane;
+    ktime_t start;
+    u64 latency;
+    int err;
+
+    inst = smu_get_instance(dev);
+    if (!inst)
+        return -ENODEV;
+
+    start = ktime_get();
+
+    lane = smu_smn_lane_lock(inst, dev);
+    if (!lane)
+        return -ENODEV;
+
+    err = smu_smn_rw_address_locked(dev, lane, address, value, write);
+    smu_smn_lane_unlock(lane);
+
+    latency = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+    smu_stats_smn(latency, err);
+    trace_smu_smn_access(dev, address, *value, write, err, latency);
+
+    return err;
+}
+
+// Attempts at reading a probe register through a lane while it doesn't change.
+#define SMU_SMN_PROBE_ATTEMPTS             4
+
+/**
+ * Reads [address] through [lane], bracketed by reads through the primary lane. The probe registers
+ *  change when a command is issued, which can't be prevented by taking the mailbox lock as SMN
+ *  accesses made under it may probe, and other software may issue commands anyway. A lane is only
+ *  rejected if it disagrees with the primary lane while the register held still.
+ * Callers must hold the locks of both lanes.
+ *
+ * Returns true if the lane read the same register.
+ */
+static bool smu_smn_lane_probe_address(struct pci_dev* dev, struct smu_instance* inst,
+    struct smu_smn_lane* lane, u32 address) {
+    u32 i, before, after, lane_val, addr_reg;
+
+    for (i = 0; i < SMU_SMN_PROBE_ATTEMPTS; i++) {
+        if (smu_smn_rw_address_locked(dev, &inst->lanes[0], address, &before, 0) ||
+            smu_smn_rw_address_locked(dev, lane, address, &lane_val, 0) ||
+            pci_read_config_dword(dev, lane->addr_reg, &addr_reg) ||
+            smu_smn_rw_address_locked(dev, &inst->lanes[0], address, &after, 0))
+            return false;
+
+        // The index register must retain the address.
+        if (addr_reg != address)
+            return false;
+
+        if (lane_val == before || lane_val == after)
+            return true;
+
+        if (before == after)
+            return false;
+    }
+
+    return false;
+}
+
+/**
+ * Verifies which of the alternate SMN lanes up to [count] work on the running processor by comparing
+ *  reads of the MP1 mailbox registers through them to reads through the primary lane.
+ * Reads through a lane that isn't an SMN window return unrelated values, disabling it and all
+ *  lanes after it. Lanes beyond [count] are left untouched, so a register pair shared with other
+ *  drivers is never written unless the user asked for it.
+ */
+static void smu_smn_lanes_probe(struct pci_dev* dev, struct smu_instance* inst, u32 count) {
+    const u32 probes[] = { g_smu.addr_mp1_mb_cmd, g_smu.addr_mp1_mb_rsp };
+    u32 i, j;
+
+    mutex_lock(&inst->lanes_probe_lock);
+
+    for (i = inst->smn_lanes_probed; i < count; i++) {
+        // Both lanes are locked so the probe doesn't race accesses already spread across them.
+        mutex_lock(&inst->lanes[0].lock);
+        mutex_lock_nested(&inst->lanes[i].lock, SINGLE_DEPTH_NESTING);
+
+        for (j = 0; j < ARRAY_SIZE(probes); j++)
+            if (!smu_smn_lane_probe_address(dev, inst, &inst->lanes[i], probes[j]))
+                break;
+
+        mutex_unlock(&inst->lanes[i].lock);
+        mutex_unlock(&inst->lanes[0].lock);
+
+        if (j != ARRAY_SIZE(probes)) {
+            pr_debug("SMN Lane [0x%X, 0x%X]: Not responding, disabling use.",
+                inst->lanes[i].addr_reg, inst->lanes[i].data_reg);
+
+            // Lanes are used in order, so none after a broken one is ever probed.
+            WRITE_ONCE(inst->smn_lanes_probed, SMU_SMN_LANES_MAX);
+            break;
+        }
+
+        WRITE_ONCE(inst->smn_lanes_valid, i + 1);
+        WRITE_ONCE(inst->smn_lanes_probed, i + 1);
+    }
+
+    mutex_unlock(&inst->lanes_probe_lock);
+
+    pr_debug("SMN Lanes: %d available on %s", inst->smn_lanes_valid, pci_name(dev));
+}
+
+static void smu_smn_lanes_init(struct pci_dev* dev, struct smu_instance* inst) {
+    u32 i;
+
+    for (i = 0; i < SMU_SMN_LANES_MAX; i++) {
+        inst->lanes[i].addr_reg = smu_smn_lane_regs[i][0];
+        inst->lanes[i].data_reg = smu_smn_lane_regs[i][1];
+    }
+
+    mutex_lock(&inst->lanes_probe_lock);
+    atomic_set(&inst->lane_next, 0);
+    inst->smn_lanes_valid = 1;
+    inst->smn_lanes_probed = 1;
+    mutex_unlock(&inst->lanes_probe_lock);
+
+    // Further lanes are probed once smn_lanes is raised to include them.
+    smu_smn_lanes_probe(dev, inst, clamp_val(smn_lanes, 1, SMU_SMN_LANES_MAX));
+}
+
 enum smu_return_val smu_read_address(struct pci_dev* dev, u32 address, u32* value) {
     return !smu_smn_rw_address(dev, address, value, 0) ? SMU_Return_OK : SMU_Return_PCIFailed;
 }
@@ -96,6 +461,65 @@ enum smu_return_val smu_write_address(struct pci_dev* dev, u32 address, u32 valu
     return !smu_smn_rw_address(dev, address, &value, 1) ? SMU_Return_OK : SMU_Return_PCIFailed;
 }
 
+enum smu_return_val smu_smn_rw_batch(struct pci_dev* dev, struct ryzen_smn_op* ops, u32 count) {
+    enum smu_return_val ret = SMU_Return_OK;
+    struct smu_instance* inst;
+    struct smu_smn_lane* lane;
+    u32 i;
+
+    inst = smu_get_instance(dev);
+    if (!inst)
+        return SMU_Return_PCIFailed;
+
+    // The whole batch is executed under a single lock acquisition.
+    lane = smu_smn_lane_lock(inst, dev);
+    if (!lane)
+        return SMU_Return_PCIFailed;
+
+    for (i = 0; i < count; i++) {
+        ops[i].status = smu_smn_rw_address_locked(dev, lane, ops[i].address, &ops[i].value,
+            ops[i].write) ? SMU_Return_PCIFailed : SMU_Return_OK;
+
+        if (ops[i].status != SMU_Return_OK)
+            ret = SMU_Return_PCIFailed;
+    }
+
+    smu_smn_lane_unlock(lane);
+
+    return ret;
+}
+
+enum smu_return_val smu_smn_rw_range(struct pci_dev* dev, u32 address, u32* values, u32 count,
+    int write, u32* done) {
+    enum smu_return_val ret = SMU_Return_OK;
+    struct smu_instance* inst;
+    struct smu_smn_lane* lane;
+    u32 i;
+
+    *done = 0;
+
+    inst = smu_get_instance(dev);
+    if (!inst)
+        return SMU_Return_PCIFailed;
+
+    lane = smu_smn_lane_lock(inst, dev);
+    if (!lane)
+        return SMU_Return_PCIFailed;
+
+    for (i = 0; i < count; i++) {
+        if (smu_smn_rw_address_locked(dev, lane, address + (i * 4), &values[i], write)) {
+            ret = SMU_Return_PCIFailed;
+            break;
+        }
+    }
+
+    smu_smn_lane_unlock(lane);
+
+    *done = i;
+
+    return ret;
+}
+
 void smu_args_init(smu_req_args_t* args, u32 value) {
     u32 i;
 
@@ -105,9 +529,68 @@ void smu_args_init(smu_req_args_t* args, u32 value) {
         args->args[i] = 0;
 }
 
-enum smu_return_val smu_send_command(struct pci_dev* dev, u32 op, smu_req_args_t* args,
-    enum smu_mailbox mailbox) {
-    u32 retries, tmp, i, rsp_addr, args_addr, cmd_addr;
+/**
+ * Polls the RSP register of a mailbox until it is non-zero or the deadline has passed, adding the
+ *  amount of reads performed to [polls].
+ *
+ * The SMU usually answers within a few microseconds so the register is spun on for a short
+ *  while before falling back to sleeping with an exponentially growing interval. This keeps
+ *  slow commands from burning a full core and makes the timeout independent of how fast PCI
+ *  config cycles are.
+ */
+static enum smu_return_val smu_wait_for_response(struct pci_dev* dev, u32 rsp_addr, u32* rsp,
+    u64 deadline, u32* polls) {
+    struct smu_poll poll;
+    u32 sleep_us;
+
+    smu_poll_init(&poll, ktime_get_ns(), deadline);
+
+    for (;;) {
+        (*polls)++;
+
+        if (smu_read_address(dev, rsp_addr, rsp) != SMU_Return_OK)
+            return SMU_Return_PCIFailed;
+
+        if (*rsp)
+            return SMU_Return_OK;
+
+        switch (smu_poll_next(&poll, ktime_get_ns(), &sleep_us)) {
+            case SMU_POLL_TIMEOUT:
+                return SMU_Return_CommandTimeout;
+            case SMU_POLL_SPIN:
+                cpu_relax();
+                break;
+            case SMU_POLL_SLEEP:
+                usleep_range(sleep_us, sleep_us * 2);
+                break;
+        }
+    }
+}
+
+static const struct smu_cmd_desc* smu_find_cmd_desc(u32 op, enum smu_mailbox mailbox) {
+    u32 i;
+
+    for (i = 0; i < ARRAY_SIZE(smu_cmds_global); i++)
+        if (smu_cmds_global[i].op == op)
+            return &smu_cmds_global[i];
+
+    if (mailbox != MAILBOX_TYPE_RSMU)
+        return NULL;
+
+    for (i = 0; i < g_smu.rsmu_cmds_count; i++)
+        if (g_smu.rsmu_cmds[i].op == op)
+            return &g_smu.rsmu_cmds[i];
+
+    return NULL;
+}
+
+static enum smu_return_val smu_execute_command(struct pci_dev* dev, struct smu_instance* inst,
+    u32 op, smu_req_args_t* args, enum smu_mailbox mailbox, const struct smu_cmd_desc* desc,
+    u32* polls) {
+    u32 tmp, i, rsp_addr, args_addr, cmd_addr, args_in, args_out;
+    enum smu_return_val ret;
+    struct mutex* lock;
+    u64 deadline;
 
     // == Pick the correct mailbox address. ==
     switch (mailbox) {
@@ -115,11 +598,13 @@ enum smu_return_val smu_send_command(struct pci_dev* dev, u32 op, smu_req_args_t
             rsp_addr = g_smu.addr_rsmu_mb_rsp;
             cmd_addr = g_smu.addr_rsmu_mb_cmd;
             args_addr = g_smu.addr_rsmu_mb_args;
+            lock = &inst->rsmu_lock;
             break;
         case MAILBOX_TYPE_MP1:
             rsp_addr = g_smu.addr_mp1_mb_rsp;
             cmd_addr = g_smu.addr_mp1_mb_cmd;
             args_addr = g_smu.addr_mp1_mb_args;
+            lock = &inst->mp1_lock;
             break;
         default:
             return SMU_Return_Unsupported;
@@ -129,64 +614,68 @@ enum smu_return_val smu_send_command(struct pci_dev* dev, u32 op, smu_req_args_t
     if (!rsp_addr || !cmd_addr || !args_addr)
         return SMU_Return_Unsupported;
 
+    // == Each argument register costs an SMN access so only touch the ones the command uses. ==
+    args_in = desc ? desc->args_in : SMU_REQ_MAX_ARGS;
+    args_out = desc ? desc->args_out : SMU_REQ_MAX_ARGS;
+
     pr_debug("SMU Service Request: ID(0x%x) Args(0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x)",
         op, args->s.arg0, args->s.arg1, args->s.arg2, args->s.arg3, args->s.arg4, args->s.arg5);
 
-    mutex_lock(&amd_smu_mutex);
+    mutex_lock(lock);
 
-    // Step 1: Wait until the RSP register is non-zero.
-    retries = smu_timeout_attempts;
-    do
-        if (smu_read_address(dev, rsp_addr, &tmp) != SMU_Return_OK) {
-            mutex_unlock(&amd_smu_mutex);
-            pr_warn("Failed to perform initial probe on SMU RSP!\n");
+    if (smu_instance_gone(inst, dev)) {
+        mutex_unlock(lock);
+        return SMU_Return_Unsupported;
+    }
 
-            return SMU_Return_PCIFailed;
-        }
-    while (tmp == 0 && retries--);
+    // The timeout covers the whole exchange, including waiting for a previous command to finish.
+    deadline = smu_poll_deadline(ktime_get_ns(), READ_ONCE(smu_timeout_us));
 
-    // Step 1.b: A command is still being processed meaning
-    //  a new command cannot be issued.
-    if (!retries && !tmp) {
-        mutex_unlock(&amd_smu_mutex);
-        pr_debug("SMU Service Request Failed: Timeout on initial wait for mailbox availability.");
+    // Step 1: Wait until the RSP register is non-zero.
+    ret = smu_wait_for_response(dev, rsp_addr, &tmp, deadline, polls);
+    if (ret != SMU_Return_OK) {
+        mutex_unlock(lock);
+
+        // Step 1.b: A command is still being processed meaning
+        //  a new command cannot be issued.
+        if (ret == SMU_Return_CommandTimeout)
+            pr_debug("SMU Service Request Failed: Timeout on initial wait for mailbox availability.");
+        else
+            pr_warn("Failed to perform initial probe on SMU RSP!\n");
 
-        return SMU_Return_CommandTimeout;
+        return ret;
     }
 
     // Step 2: Write zero (0) to the RSP register.
     smu_write_address(dev, rsp_addr, 0);
 
     // Step 3: Write the argument(s) into the argument register(s).
-    for (i = 0; i < SMU_REQ_MAX_ARGS; i++)
+    for (i = 0; i < args_in; i++)
         smu_write_address(dev, args_addr + (i * 4), args->args[i]);
 
     // Step 4: Write the message Id into the Message ID register.
     smu_write_address(dev, cmd_addr, op);
 
     // Step 5: Wait until the Response register is non-zero.
-    do
-        if (smu_read_address(dev, rsp_addr, &tmp) != SMU_Return_OK) {
-            mutex_unlock(&amd_smu_mutex);
+    ret = smu_wait_for_response(dev, rsp_addr, &tmp, deadline, polls);
+    if (ret != SMU_Return_OK) {
+        mutex_unlock(lock);
+
+        // The RSP register is still 0, the SMU is still processing the request or has frozen.
+        // Either way the command has timed out so indicate as such.
+        if (ret == SMU_Return_CommandTimeout)
+            pr_debug("SMU Service Request Failed: Timeout on command (0x%x) after %u us.",
+                op, smu_timeout_us);
+        else
             pr_warn("Failed to perform probe on SMU RSP!\n");
 
-            return SMU_Return_PCIFailed;
-        }
-    while(tmp == 0 && retries--);
+        return ret;
+    }
 
     // Step 6: If the Response register contains OK, then SMU has finished processing
     //  the message.
-    if (tmp != SMU_Return_OK && !retries) {
-        mutex_unlock(&amd_smu_mutex);
-
-        // The RSP register is still 0, the SMU is still processing the request or has frozen.
-        // Either way the command has timed out so indicate as such.
-        if (!tmp) {
-            pr_debug("SMU Service Request Failed: Timeout on command (0x%x) after %d attempts.",
-                op, smu_timeout_attempts);
-
-            return SMU_Return_CommandTimeout;
-        }
+    if (tmp != SMU_Return_OK) {
+        mutex_unlock(lock);
 
         pr_debug("SMU Service Request Failed: Response %Xh was unexpected.", tmp);
         return tmp;
@@ -194,11 +683,11 @@ enum smu_return_val smu_send_command(struct pci_dev* dev, u32 op, smu_req_args_t
 
     // Step 7: If a return argument is expected, the Argument register may be read
     //  at this time.
-    for (i = 0; i < SMU_REQ_MAX_ARGS; i++)
+    for (i = 0; i < args_out; i++)
         if (smu_read_address(dev, args_addr + (i * 4), &args->args[i]) != SMU_Return_OK)
             pr_warn("Failed to fetch SMU ARG [%d]!\n", i);
 
-    mutex_unlock(&amd_smu_mutex);
+    mutex_unlock(lock);
 
     pr_debug("SMU Service Response: ID(0x%x) Args(0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x)",
         op, args->s.arg0, args->s.arg1, args->s.arg2, args->s.arg3, args->s.arg4, args->s.arg5);
@@ -206,6 +695,135 @@ enum smu_return_val smu_send_command(struct pci_dev* dev, u32 op, smu_req_args_t
     return SMU_Return_OK;
 }
 
+static struct smu_cache_entry* smu_cache_find(struct smu_instance* inst,
+    const struct smu_cmd_desc* desc, enum smu_mailbox mailbox, const smu_req_args_t* args) {
+    struct smu_cache_entry* entry;
+    u32 i;
+
+    for (i = 0; i < SMU_CACHE_ENTRIES; i++) {
+        entry = &inst->cache[i];
+
+        if (entry->valid && entry->op == desc->op && entry->mailbox == mailbox &&
+            !memcmp(entry->args, args->args, desc->args_in * sizeof(u32)))
+            return entry;
+    }
+
+    return NULL;
+}
+
+/**
+ * Returns whether the results of the command were cached, in which case they're stored in [args].
+ */
+static bool smu_cache_lookup(struct smu_instance* inst, const struct smu_cmd_desc* desc,
+    enum smu_mailbox mailbox, smu_req_args_t* args) {
+    struct smu_cache_entry* entry;
+    bool hit = false;
+
+    spin_lock(&inst->cache_lock);
+
+    entry = smu_cache_find(inst, desc, mailbox, args);
+    if (entry) {
+        if (entry->expires && ktime_after(ktime_get(), entry->expires))
+            entry->valid = false;
+        else {
+            memcpy(args->args, entry->results, desc->args_out * sizeof(u32));
+            hit = true;
+        }
+    }
+
+    spin_unlock(&inst->cache_lock);
+
+    return hit;
+}
+
+static void smu_cache_store(struct smu_instance* inst, const struct smu_cmd_desc* desc,
+    enum smu_mailbox mailbox, const smu_req_args_t* sent, const smu_req_args_t* results) {
+    struct smu_cache_entry* entry;
+
+    spin_lock(&inst->cache_lock);
+
+    entry = smu_cache_find(inst, desc, mailbox, sent);
+    if (!entry) {
+        entry = &inst->cache[inst->cache_next];
+        inst->cache_next = (inst->cache_next + 1) % SMU_CACHE_ENTRIES;
+    }
+
+    entry->valid = true;
+    entry->mailbox = mailbox;
+    entry->group = desc->cache_group;
+    entry->op = desc->op;
+    memcpy(entry->args, sent->args, sizeof(entry->args));
+    memcpy(entry->results, results->args, sizeof(entry->results));
+
+    entry->expires = desc->cache_ttl_ms == SMU_CACHE_FOREVER ? 0 :
+        ktime_add_ms(ktime_get(), desc->cache_ttl_ms);
+
+    spin_unlock(&inst->cache_lock);
+}
+
+static void smu_cache_invalidate(struct smu_instance* inst, u8 groups) {
+    u32 i;
+
+    spin_lock(&inst->cache_lock);
+
+    for (i = 0; i < SMU_CACHE_ENTRIES; i++) {
+        if (inst->cache[i].valid && (inst->cache[i].group & groups)) {
+            inst->cache[i].valid = false;
+            smu_stats_cache(SMU_STATS_CACHE_INVALIDATE);
+        }
+    }
+
+    spin_unlock(&inst->cache_lock);
+}
+
+enum smu_return_val smu_send_command(struct pci_dev* dev, u32 op, smu_req_args_t* args,
+    enum smu_mailbox mailbox) {
+    const struct smu_cmd_desc* desc;
+    struct smu_instance* inst;
+    enum smu_return_val ret;
+    smu_req_args_t sent;
+    bool cached;
+    u32 polls = 0;
+    ktime_t start;
+    u64 latency;
+
+    inst = smu_get_instance(dev);
+    if (!inst)
+        return SMU_Return_Unsupported;
+
+    desc = smu_find_cmd_desc(op, mailbox);
+
+    // == Getters with constant results don't need to go through the mailbox again. ==
+    cached = smu_cache && desc && desc->cache_ttl_ms;
+    if (cached) {
+        if (smu_cache_lookup(inst, desc, mailbox, args)) {
+            smu_stats_cache(SMU_STATS_CACHE_HIT);
+            return SMU_Return_OK;
+        }
+
+        smu_stats_cache(SMU_STATS_CACHE_MISS);
+        sent = *args;
+    }
+
+    trace_smu_cmd_start(dev, mailbox, op, args->args);
+
+    start = ktime_get();
+    ret = smu_execute_command(dev, inst, op, args, mailbox, desc, &polls);
+    latency = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+    smu_stats_command(mailbox, op, ret, latency, polls);
+    trace_smu_cmd_end(dev, mailbox, op, args->args, ret, polls, latency);
+
+    if (ret == SMU_Return_OK && cached)
+        smu_cache_store(inst, desc, mailbox, &sent, args);
+
+    // Setters invalidate even when rejected, as the SMU may have partially applied them.
+    if (desc && desc->cache_invalidates)
+        smu_cache_invalidate(inst, desc->cache_invalidates);
+
+    return ret;
+}
+
 int smu_resolve_cpu_class(struct pci_dev* dev) {
     u32 cpuid, cpu_family, cpu_model, stepping, pkg_type;
 
@@ -300,20 +918,25 @@ int smu_resolve_cpu_class(struct pci_dev* dev) {
     }
 }
 
-int smu_init(struct pci_dev* dev) {
-    // This really should never be called twice however in case it is, consider it initialized.
-    if (g_smu.codename != CODENAME_UNDEFINED)
-        return 0;
-
+/**
+ * Resolves the processor codename and the mailbox layout shared by every SMU of the system.
+ */
+static int smu_init_processor(struct pci_dev* dev) {
     if (smu_resolve_cpu_class(dev))
         return -ENODEV;
 
     // Detect RSMU mailbox address.
     switch (g_smu.codename) {
-        case CODENAME_CASTLEPEAK:
         case CODENAME_MATISSE:
         case CODENAME_VERMEER:
+            g_smu.rsmu_cmds         = smu_rsmu_cmds_matisse;
+            g_smu.rsmu_cmds_count   = ARRAY_SIZE(smu_rsmu_cmds_matisse);
+            goto RSMU_CLASS_1;
+        case CODENAME_CASTLEPEAK:
         case CODENAME_MILAN:
+            g_smu.rsmu_cmds         = smu_rsmu_cmds_castlepeak;
+            g_smu.rsmu_cmds_count   = ARRAY_SIZE(smu_rsmu_cmds_castlepeak);
+        RSMU_CLASS_1:
             g_smu.addr_rsmu_mb_cmd  = 0x3B10524;
             g_smu.addr_rsmu_mb_rsp  = 0x3B10570;
             g_smu.addr_rsmu_mb_args = 0x3B10A40;
@@ -327,11 +950,17 @@ int smu_init(struct pci_dev* dev) {
             g_smu.addr_rsmu_mb_args = 0x3B10590;
             goto LOG_RSMU;
         case CODENAME_RENOIR:
-        case CODENAME_PICASSO:
         case CODENAME_CEZANNE:
+            g_smu.rsmu_cmds         = smu_rsmu_cmds_renoir;
+            g_smu.rsmu_cmds_count   = ARRAY_SIZE(smu_rsmu_cmds_renoir);
+            goto RSMU_CLASS_3;
+        case CODENAME_PICASSO:
         case CODENAME_RAVENRIDGE:
         case CODENAME_RAVENRIDGE2:
         case CODENAME_DALI:
+            g_smu.rsmu_cmds         = smu_rsmu_cmds_picasso;
+            g_smu.rsmu_cmds_count   = ARRAY_SIZE(smu_rsmu_cmds_picasso);
+        RSMU_CLASS_3:
             g_smu.addr_rsmu_mb_cmd  = 0x3B10A20;
             g_smu.addr_rsmu_mb_rsp  = 0x3B10A80;
             g_smu.addr_rsmu_mb_args = 0x3B10A88;
@@ -404,26 +1033,143 @@ MP1_DETECT:
     return 0;
 }
 
-void smu_cleanup(void) {
+int smu_init(struct pci_dev* dev) {
+    struct smu_instance* inst = NULL;
+    int err = 0;
+    u32 i;
+
+    mutex_lock(&smu_instances_mutex);
+
+    // This really should never be called twice however in case it is, consider it initialized.
+    if (smu_get_instance(dev))
+        goto BREAK_OUT;
+
+    // The processor is only resolved by the first instance.
+    if (g_smu.codename == CODENAME_UNDEFINED) {
+        err = smu_init_processor(dev);
+        if (err) {
+            g_smu.codename = CODENAME_UNDEFINED;
+            goto BREAK_OUT;
+        }
+    }
+
+    for (i = 0; i < SMU_MAX_NODES; i++) {
+        if (!g_smu_instances[i].dev) {
+            inst = &g_smu_instances[i];
+            break;
+        }
+    }
+
+    if (!inst) {
+        pr_err("Unable to track more than %d SMUs", SMU_MAX_NODES);
+        err = -ENOSPC;
+        goto BREAK_OUT;
+    }
+
+    if (!inst->initialized) {
+        mutex_init(&inst->rsmu_lock);
+        mutex_init(&inst->mp1_lock);
+        spin_lock_init(&inst->cache_lock);
+        mutex_init(&inst->pm_lock);
+        mutex_init(&inst->lanes_probe_lock);
+
+        for (i = 0; i < SMU_SMN_LANES_MAX; i++)
+            mutex_init(&inst->lanes[i].lock);
+
+        inst->initialized = true;
+    }
+
+    // A previous device of the slot may have left state behind, which is reset under the locks it
+    //  is used under as callers of that device may still hold them until they notice it's gone.
+    spin_lock(&inst->cache_lock);
+    memset(inst->cache, 0, sizeof(inst->cache));
+    inst->cache_next = 0;
+    spin_unlock(&inst->cache_lock);
+
+    mutex_lock(&inst->pm_lock);
+    inst->pm_generation = 0;
+    inst->pm_dram_base = 0;
+    inst->pm_dram_base_alt = 0;
+    inst->pm_dram_map_size = 0;
+    inst->pm_dram_map_size_alt = 0;
+    inst->pm_refreshed = 0;
+    mutex_unlock(&inst->pm_lock);
+
+    // The instance isn't published yet so the lanes can be probed without racing its users.
+    smu_smn_lanes_init(dev, inst);
+
+    WRITE_ONCE(inst->dev, dev);
+
+BREAK_OUT:
+    mutex_unlock(&smu_instances_mutex);
+
+    return err;
+}
+
+void smu_cleanup(struct pci_dev* dev) {
+    struct smu_instance* inst;
+    u32 i;
+
+    mutex_lock(&smu_instances_mutex);
+
+    inst = smu_get_instance(dev);
+    if (!inst)
+        goto BREAK_OUT;
+
+    // Readers which looked the instance up before this point check whether it's gone once they
+    //  hold the PM lock, so the table is never copied from an unmapped DRAM base.
+    mutex_lock(&inst->pm_lock);
+
+    WRITE_ONCE(inst->dev, NULL);
+
     // Unmap DRAM Base if required after SMU use.
-    if (g_smu.pm_table_virt_addr) {
-        iounmap(g_smu.pm_table_virt_addr);
-        g_smu.pm_table_virt_addr = NULL;
+    if (inst->pm_table_virt_addr) {
+        iounmap(inst->pm_table_virt_addr);
+        inst->pm_table_virt_addr = NULL;
+    }
+
+    if (inst->pm_table_virt_addr_alt) {
+        iounmap(inst->pm_table_virt_addr_alt);
+        inst->pm_table_virt_addr_alt = NULL;
     }
 
-    if (g_smu.pm_table_virt_addr_alt) {
-        iounmap(g_smu.pm_table_virt_addr_alt);
-        g_smu.pm_table_virt_addr_alt = NULL;
+    mutex_unlock(&inst->pm_lock);
+
+    // Waits out accesses which checked the instance before it was gone, every later one notices.
+    mutex_lock(&inst->rsmu_lock);
+    mutex_unlock(&inst->rsmu_lock);
+    mutex_lock(&inst->mp1_lock);
+    mutex_unlock(&inst->mp1_lock);
+    mutex_lock(&inst->lanes_probe_lock);
+    mutex_unlock(&inst->lanes_probe_lock);
+
+    for (i = 0; i < SMU_SMN_LANES_MAX; i++) {
+        mutex_lock(&inst->lanes[i].lock);
+        mutex_unlock(&inst->lanes[i].lock);
     }
 
-    // Set SMU state to uninitialized, requiring a call to smu_init() again.
+    for (i = 0; i < SMU_MAX_NODES; i++)
+        if (g_smu_instances[i].dev)
+            goto BREAK_OUT;
+
+    // Set SMU state to uninitialized once the last instance is gone, requiring a call to
+    //  smu_init() again.
     g_smu.codename = CODENAME_UNDEFINED;
+
+BREAK_OUT:
+    mutex_unlock(&smu_instances_mutex);
 }
 
 enum smu_processor_codename smu_get_codename(void) {
     return g_smu.codename;
 }
 
+u32 smu_get_smn_lanes(struct pci_dev* dev) {
+    struct smu_instance* inst = smu_get_instance(dev);
+
+    return inst ? inst->smn_lanes_valid : 0;
+}
+
 u32 smu_get_version(struct pci_dev* dev, enum smu_mailbox mb) {
     smu_req_args_t args;
     u32 ret;
@@ -612,23 +1358,23 @@ enum smu_return_val smu_get_pm_table_version(struct pci_dev* dev, u32* version)
     return ret;
 }
 
-u32 smu_update_pmtable_size(u32 version) {
+static u32 smu_update_pmtable_size(struct smu_instance* inst, u32 version) {
     // These sizes are actually accurate and not just "guessed".
     // Source: Ryzen Master.
     switch (g_smu.codename) {
         case CODENAME_MATISSE:
             switch (version) {
                 case 0x240902:
-                    g_smu.pm_dram_map_size = 0x514;
+                    inst->pm_dram_map_size = 0x514;
                     break;
                 case 0x240903:
-                    g_smu.pm_dram_map_size = 0x518;
+                    inst->pm_dram_map_size = 0x518;
                     break;
                 case 0x240802:
-                    g_smu.pm_dram_map_size = 0x7E0;
+                    inst->pm_dram_map_size = 0x7E0;
                     break;
                 case 0x240803:
-                    g_smu.pm_dram_map_size = 0x7E4;
+                    inst->pm_dram_map_size = 0x7E4;
                     break;
                 default:
                 UNKNOWN_PM_TABLE_VERSION:
@@ -638,22 +1384,22 @@ u32 smu_update_pmtable_size(u32 version) {
         case CODENAME_VERMEER:
             switch (version) {
                 case 0x2D0903:
-                    g_smu.pm_dram_map_size = 0x594;
+                    inst->pm_dram_map_size = 0x594;
                     break;
                 case 0x380904:
-                    g_smu.pm_dram_map_size = 0x5A4;
+                    inst->pm_dram_map_size = 0x5A4;
                     break;
                 case 0x380905:
-                    g_smu.pm_dram_map_size = 0x5D0;
+                    inst->pm_dram_map_size = 0x5D0;
                     break;
                 case 0x2D0803:
-                    g_smu.pm_dram_map_size = 0x894;
+                    inst->pm_dram_map_size = 0x894;
                     break;
                 case 0x380804:
-                    g_smu.pm_dram_map_size = 0x8A4;
+                    inst->pm_dram_map_size = 0x8A4;
                     break;
                 case 0x380805:
-                    g_smu.pm_dram_map_size = 0x8F0;
+                    inst->pm_dram_map_size = 0x8F0;
                     break;
                 default:
                     goto UNKNOWN_PM_TABLE_VERSION;
@@ -662,7 +1408,7 @@ u32 smu_update_pmtable_size(u32 version) {
         case CODENAME_MILAN:
             switch (version) {
                 case 0x2D0008:
-                    g_smu.pm_dram_map_size = 0x1AB0;
+                    inst->pm_dram_map_size = 0x1AB0;
                     break;
                 default:
                     goto UNKNOWN_PM_TABLE_VERSION;
@@ -671,20 +1417,20 @@ u32 smu_update_pmtable_size(u32 version) {
         case CODENAME_RENOIR:
             switch (version) {
                 case 0x370000:
-                    g_smu.pm_dram_map_size = 0x794;
+                    inst->pm_dram_map_size = 0x794;
                     break;
                 case 0x370001:
-                    g_smu.pm_dram_map_size = 0x884;
+                    inst->pm_dram_map_size = 0x884;
                     break;
                 case 0x370002:
                 case 0x370003:
-                    g_smu.pm_dram_map_size = 0x88C;
+                    inst->pm_dram_map_size = 0x88C;
                     break;
                 case 0x370004:
-                    g_smu.pm_dram_map_size = 0x8AC;
+                    inst->pm_dram_map_size = 0x8AC;
                     break;
                 case 0x370005:
-                    g_smu.pm_dram_map_size = 0x8C8;
+                    inst->pm_dram_map_size = 0x8C8;
                     break;
                 default:
                     goto UNKNOWN_PM_TABLE_VERSION;
@@ -693,7 +1439,7 @@ u32 smu_update_pmtable_size(u32 version) {
         case CODENAME_CEZANNE:
             switch (version) {
                 case 0x400005:
-                    g_smu.pm_dram_map_size = 0x944;
+                    inst->pm_dram_map_size = 0x944;
                     break;
                 default:
                     goto UNKNOWN_PM_TABLE_VERSION;
@@ -705,12 +1451,12 @@ u32 smu_update_pmtable_size(u32 version) {
             // These codenames have two PM tables, a larger (primary) one and a smaller one.
             // The size is always fixed to 0x608 and 0xA4 bytes each.
             // Source: Ryzen Master.
-            g_smu.pm_dram_map_size_alt = 0xA4;
-            g_smu.pm_dram_map_size = 0x608 + g_smu.pm_dram_map_size_alt;
+            inst->pm_dram_map_size_alt = 0xA4;
+            inst->pm_dram_map_size = 0x608 + inst->pm_dram_map_size_alt;
 
             // Split DRAM base into high/low values.
-            g_smu.pm_dram_base_alt = g_smu.pm_dram_base >> 32;
-            g_smu.pm_dram_base &= 0xFFFFFFFF;
+            inst->pm_dram_base_alt = inst->pm_dram_base >> 32;
+            inst->pm_dram_base &= 0xFFFFFFFF;
             break;
         default:
             return SMU_Return_Unsupported;
@@ -719,20 +1465,25 @@ u32 smu_update_pmtable_size(u32 version) {
     return SMU_Return_OK;
 }
 
-enum smu_return_val smu_read_pm_table(struct pci_dev* dev, unsigned char* dst, size_t* len) {
+// Determines the size of the PM table, has the SMU refresh it if needed and maps it.
+// Callers must hold the PM lock of the instance, [gen] is the generation seen before taking it.
+static enum smu_return_val smu_prepare_pm_table_locked(struct pci_dev* dev, struct smu_instance* inst,
+    u32 gen, u32 max_age_us) {
     u32 ret, version, size;
+    ktime_t start = 0;
+    bool traced;
 
     // The DRAM base does not change after boot meaning it only needs to be
     //  fetched once.
     // From testing, it also seems they are always mapped to the same address as well,
     //  at least when running the same AGESA version.
-    if (g_smu.pm_dram_base == 0 || g_smu.pm_dram_map_size == 0) {
-        g_smu.pm_dram_base = smu_get_dram_base_address(dev);
+    if (inst->pm_dram_base == 0 || inst->pm_dram_map_size == 0) {
+        inst->pm_dram_base = smu_get_dram_base_address(dev);
 
         // Verify returned value isn't an SMU return value.
-        if (g_smu.pm_dram_base < 0xFF && g_smu.pm_dram_base >= 0) {
-            pr_err("Unable to receive the DRAM base address: %X", (u8)g_smu.pm_dram_base);
-            return g_smu.pm_dram_base;
+        if (inst->pm_dram_base < 0xFF && inst->pm_dram_base >= 0) {
+            pr_err("Unable to receive the DRAM base address: %X", (u8)inst->pm_dram_base);
+            return inst->pm_dram_base;
         }
 
         // Should help us catch where we missed table version initialization in the future.
@@ -752,73 +1503,364 @@ enum smu_return_val smu_read_pm_table(struct pci_dev* dev, unsigned char* dst, s
             }
         }
 
-        ret = smu_update_pmtable_size(version);
+        ret = smu_update_pmtable_size(inst, version);
         if (ret != SMU_Return_OK) {
             pr_err("Unknown PM table version: 0x%08X", version);
             return ret;
         }
 
         pr_debug("Determined PM mapping size as (%xh,%xh) bytes.",
-            g_smu.pm_dram_map_size, g_smu.pm_dram_map_size_alt);
+            inst->pm_dram_map_size, inst->pm_dram_map_size_alt);
     }
 
-    // Validate output buffer size.
-    // N.B. In the case of Picasso/RavenRidge 2, we include the secondary PM Table size as well
-    if (*len < g_smu.pm_dram_map_size) {
-        pr_warn("Insufficient buffer size for PM table read: %lu < %d",
-            *len, g_smu.pm_dram_map_size);
+    // Readers which waited for the refresh of another reader share its result, otherwise only
+    //  refresh the table if it is older than the reader accepts.
+    if (inst->pm_generation == gen &&
+        (!inst->pm_refreshed || ktime_us_delta(ktime_get(), inst->pm_refreshed) >= max_age_us)) {
+        // Latched so that a tracepoint enabled mid-transfer doesn't report a bogus duration.
+        traced = trace_smu_pm_table_transfer_enabled();
+        inst->pm_refreshed = ktime_get();
 
-        *len = g_smu.pm_dram_map_size;
-        return SMU_Return_InsufficientSize;
-    }
+        if (traced)
+            start = ktime_get();
 
-    // Clamp output size
-    *len = g_smu.pm_dram_map_size;
+        ret = smu_transfer_table_to_dram(dev);
 
-    // Check if we should tell the SMU to refresh the table via jiffies.
-    // Use a minimum interval of 1 ms.
-    if (!g_smu.pm_jiffies || time_after(jiffies, g_smu.pm_jiffies + msecs_to_jiffies(1))) {
-        g_smu.pm_jiffies = jiffies;
+        if (traced)
+            trace_smu_pm_table_transfer(dev, ret, ktime_to_ns(ktime_sub(ktime_get(), start)));
 
-        ret = smu_transfer_table_to_dram(dev);
         if (ret != SMU_Return_OK)
             return ret;
+
+        WRITE_ONCE(inst->pm_generation, inst->pm_generation + 1);
     }
 
     // Primary PM Table size
-    size = g_smu.pm_dram_map_size - g_smu.pm_dram_map_size_alt;
+    size = inst->pm_dram_map_size - inst->pm_dram_map_size_alt;
 
     // We only map the DRAM base(s) once for use.
-    if (g_smu.pm_table_virt_addr == NULL) {
+    if (inst->pm_table_virt_addr == NULL) {
         // From Linux documentation, it seems we should use _cache() for ioremap().
-        g_smu.pm_table_virt_addr = ioremap_cache(g_smu.pm_dram_base, size);
+        inst->pm_table_virt_addr = ioremap_cache(inst->pm_dram_base, size);
 
-        if (g_smu.pm_table_virt_addr == NULL) {
-            pr_err("Failed to map DRAM base: %llX (0x%X B)", g_smu.pm_dram_base, size);
+        if (inst->pm_table_virt_addr == NULL) {
+            pr_err("Failed to map DRAM base: %llX (0x%X B)", inst->pm_dram_base, size);
             return SMU_Return_MappedError;
         }
 
         // In Picasso/RavenRidge 2, we map the secondary (high) address as well.
-        if (g_smu.pm_dram_map_size_alt) {
-            g_smu.pm_table_virt_addr_alt = ioremap_cache(
-                g_smu.pm_dram_base_alt,
-                g_smu.pm_dram_map_size_alt
+        if (inst->pm_dram_map_size_alt) {
+            inst->pm_table_virt_addr_alt = ioremap_cache(
+                inst->pm_dram_base_alt,
+                inst->pm_dram_map_size_alt
             );
 
-            if (g_smu.pm_table_virt_addr_alt == NULL) {
-                pr_err("Failed to map DRAM alt base: %X (0x%X B)", g_smu.pm_dram_base_alt, g_smu.pm_dram_map_size_alt);
+            if (inst->pm_table_virt_addr_alt == NULL) {
+                pr_err("Failed to map DRAM alt base: %X (0x%X B)", inst->pm_dram_base_alt, inst->pm_dram_map_size_alt);
                 return SMU_Return_MappedError;
             }
         }
     }
 
-    // memcpy() seems to work as well but according to Linux, for physically mapped addresses,
-    //  we should use _fromio().
-    memcpy_fromio(dst, g_smu.pm_table_virt_addr, size);
+    return SMU_Return_OK;
+}
+
+// Copies in 64 byte blocks, issuing the eight loads of a block before storing any of them so that a
+//  whole cache line is in flight at once. Falls back to memcpy_fromio() for unaligned buffers and
+//  for the tail of the table.
+static void smu_pm_copy_wide(u8* dst, const u8 __iomem* src, u32 len) {
+#ifdef CONFIG_64BIT
+    const u64 __iomem* s = (const u64 __iomem*)src;
+    u64* d = (u64*)dst;
+    u64 a, b, c, e, f, g, h, i;
+
+    if (IS_ALIGNED((unsigned long)dst | (unsigned long)src, sizeof(u64))) {
+        for (; len >= 64; len -= 64, s += 8, d += 8) {
+            a = __raw_readq(s + 0);
+            b = __raw_readq(s + 1);
+            c = __raw_readq(s + 2);
+            e = __raw_readq(s + 3);
+            f = __raw_readq(s + 4);
+            g = __raw_readq(s + 5);
+            h = __raw_readq(s + 6);
+            i = __raw_readq(s + 7);
+
+            d[0] = a;
+            d[1] = b;
+            d[2] = c;
+            d[3] = e;
+            d[4] = f;
+            d[5] = g;
+            d[6] = h;
+            d[7] = i;
+        }
+
+        dst = (u8*)d;
+        src = (const u8 __iomem*)s;
+    }
+#endif
+
+    memcpy_fromio(dst, src, len);
+}
+
+static void smu_pm_copy(u8* dst, const u8 __iomem* src, u32 len, u32 strategy) {
+    switch (strategy) {
+        case SMU_PM_COPY_MEMCPY:
+            memcpy(dst, (const void __force*)src, len);
+            break;
+        case SMU_PM_COPY_WIDE:
+            smu_pm_copy_wide(dst, src, len);
+            break;
+        default:
+            memcpy_fromio(dst, src, len);
+            break;
+    }
+}
+
+// Copies the whole table, including the secondary table if required, into [dst].
+// Callers must hold the PM lock of the instance, after the table was prepared.
+static void smu_copy_pm_table_locked(struct smu_instance* inst, u8* dst, u32 strategy) {
+    u32 size;
+
+    // Primary PM Table size
+    size = inst->pm_dram_map_size - inst->pm_dram_map_size_alt;
+
+    smu_pm_copy(dst, inst->pm_table_virt_addr, size, strategy);
 
     // Append secondary table if required.
-    if (g_smu.pm_dram_map_size_alt)
-        memcpy_fromio(dst + size, g_smu.pm_table_virt_addr_alt, g_smu.pm_dram_map_size_alt);
+    if (inst->pm_dram_map_size_alt)
+        smu_pm_copy(dst + size, inst->pm_table_virt_addr_alt, inst->pm_dram_map_size_alt, strategy);
+}
+
+// Callers must hold the PM lock of the instance, [gen] is the generation seen before taking it.
+static enum smu_return_val smu_read_pm_table_locked(struct pci_dev* dev, struct smu_instance* inst,
+    unsigned char* dst, size_t* len, u32 gen, u32 max_age_us) {
+    ktime_t start = 0;
+    bool traced;
+    u32 ret;
+
+    ret = smu_prepare_pm_table_locked(dev, inst, gen, max_age_us);
+    if (ret != SMU_Return_OK)
+        return ret;
+
+    // Validate output buffer size.
+    // N.B. In the case of Picasso/RavenRidge 2, we include the secondary PM Table size as well
+    if (*len < inst->pm_dram_map_size) {
+        pr_warn("Insufficient buffer size for PM table read: %lu < %d",
+            *len, inst->pm_dram_map_size);
+
+        *len = inst->pm_dram_map_size;
+        return SMU_Return_InsufficientSize;
+    }
+
+    // Clamp output size
+    *len = inst->pm_dram_map_size;
+
+    traced = trace_smu_pm_table_copy_enabled();
+    if (traced)
+        start = ktime_get();
+
+    smu_copy_pm_table_locked(inst, dst, READ_ONCE(pm_copy_strategy));
+
+    if (traced)
+        trace_smu_pm_table_copy(dev, inst->pm_dram_map_size,
+            ktime_to_ns(ktime_sub(ktime_get(), start)));
 
     return SMU_Return_OK;
 }
+
+// Copies [len] bytes of the table starting at [off], which must be within the table, to [dst].
+// Callers must hold the PM lock of the instance, after the table was prepared.
+static void smu_copy_pm_table_range_locked(struct smu_instance* inst, u8* dst, u32 off, u32 len) {
+    u32 size, n;
+
+    size = inst->pm_dram_map_size - inst->pm_dram_map_size_alt;
+
+    if (off < size) {
+        n = min(len, size - off);
+
+        memcpy_fromio(dst, inst->pm_table_virt_addr + off, n);
+
+        dst += n;
+        off += n;
+        len -= n;
+    }
+
+    // Remainder from the secondary table.
+    if (len)
+        memcpy_fromio(dst, inst->pm_table_virt_addr_alt + off - size, len);
+}
+
+enum smu_return_val smu_read_pm_table(struct pci_dev* dev, unsigned char* dst, size_t* len) {
+    return smu_read_pm_table_aged(dev, dst, len,
+        min_t(u32, READ_ONCE(pm_refresh_interval_us), PM_REFRESH_INTERVAL_MAX_US), NULL);
+}
+
+enum smu_return_val smu_read_pm_table_aged(struct pci_dev* dev, unsigned char* dst, size_t* len,
+    u32 max_age_us, ktime_t* refreshed) {
+    struct smu_instance* inst;
+    enum smu_return_val ret;
+    u32 gen;
+
+    inst = smu_get_instance(dev);
+    if (!inst)
+        return SMU_Return_Unsupported;
+
+    // Sampled before waiting for the lock so that a refresh completing in the meantime is joined
+    //  rather than repeated. The table is only ever copied under the lock, so every reader
+    //  sharing a refresh receives the same contents.
+    gen = READ_ONCE(inst->pm_generation);
+
+    mutex_lock(&inst->pm_lock);
+
+    if (smu_instance_gone(inst, dev)) {
+        mutex_unlock(&inst->pm_lock);
+        return SMU_Return_Unsupported;
+    }
+
+    ret = smu_read_pm_table_locked(dev, inst, dst, len, gen, max_age_us);
+
+    if (refreshed)
+        *refreshed = inst->pm_refreshed;
+
+    mutex_unlock(&inst->pm_lock);
+
+    return ret;
+}
+
+enum smu_return_val smu_read_pm_table_range(struct pci_dev* dev, u8* dst, loff_t off, size_t* len,
+    u32 max_age_us) {
+    struct smu_instance* inst;
+    enum smu_return_val ret;
+    ktime_t start = 0;
+    bool traced;
+    u32 gen;
+
+    inst = smu_get_instance(dev);
+    if (!inst)
+        return SMU_Return_Unsupported;
+
+    if (off < 0)
+        return SMU_Return_InvalidArgument;
+
+    gen = READ_ONCE(inst->pm_generation);
+
+    mutex_lock(&inst->pm_lock);
+
+    if (smu_instance_gone(inst, dev)) {
+        ret = SMU_Return_Unsupported;
+        goto BREAK_OUT;
+    }
+
+    ret = smu_prepare_pm_table_locked(dev, inst, gen, max_age_us);
+    if (ret != SMU_Return_OK)
+        goto BREAK_OUT;
+
+    // Reads past the end of the table are empty.
+    *len = off < inst->pm_dram_map_size ? min_t(size_t, *len, inst->pm_dram_map_size - off) : 0;
+    if (!*len)
+        goto BREAK_OUT;
+
+    traced = trace_smu_pm_table_copy_enabled();
+    if (traced)
+        start = ktime_get();
+
+    smu_copy_pm_table_range_locked(inst, dst, off, *len);
+
+    if (traced)
+        trace_smu_pm_table_copy(dev, *len, ktime_to_ns(ktime_sub(ktime_get(), start)));
+
+BREAK_OUT:
+    mutex_unlock(&inst->pm_lock);
+
+    return ret;
+}
+
+enum smu_return_val smu_read_pm_table_user(struct pci_dev* dev, void __user* dst, loff_t off,
+    size_t* len) {
+    u8 buf[SMU_PM_USER_STACK_SIZE];
+    enum smu_return_val ret;
+    u8* bounce = buf;
+
+    // The table is copied to a kernel buffer and from there to userspace once unlocked, so that a
+    //  faulting reader doesn't hold up every other reader of the table. Reads of a few fields fit
+    //  on the stack.
+    *len = min_t(size_t, *len, PM_TABLE_MAX_SIZE);
+
+    if (*len > sizeof(buf)) {
+        bounce = kmalloc(*len, GFP_KERNEL);
+        if (!bounce)
+            return SMU_Return_InsufficientSize;
+    }
+
+    ret = smu_read_pm_table_range(dev, bounce, off, len,
+        min_t(u32, READ_ONCE(pm_refresh_interval_us), PM_REFRESH_INTERVAL_MAX_US));
+
+    if (ret == SMU_Return_OK && *len && copy_to_user(dst, bounce, *len))
+        ret = SMU_Return_InvalidArgument;
+
+    if (bounce != buf)
+        kfree(bounce);
+
+    return ret;
+}
+
+enum smu_return_val smu_bench_pm_table_copy(u32 index, enum smu_pm_copy_strategy strategy, bool cold,
+    struct pci_dev** dev, u64* ns) {
+    struct smu_instance* inst;
+    enum smu_return_val ret;
+    u64 start, total = 0;
+    u8* buff;
+    u32 i;
+
+    if (index >= SMU_MAX_NODES || strategy >= SMU_PM_COPY_COUNT)
+        return SMU_Return_InvalidArgument;
+
+    buff = kmalloc(PM_TABLE_MAX_SIZE, GFP_KERNEL);
+    if (!buff)
+        return SMU_Return_Failed;
+
+    // Keeps the mapping from being unmapped by smu_cleanup() for the duration.
+    mutex_lock(&smu_instances_mutex);
+
+    inst = &g_smu_instances[index];
+    if (!inst->dev) {
+        ret = SMU_Return_Unsupported;
+        goto BREAK_OUT;
+    }
+
+    *dev = inst->dev;
+
+    mutex_lock(&inst->pm_lock);
+
+    ret = smu_prepare_pm_table_locked(inst->dev, inst, READ_ONCE(inst->pm_generation), U32_MAX);
+    if (ret != SMU_Return_OK)
+        goto UNLOCK_PM;
+
+    for (i = 0; i < SMU_PM_COPY_BENCH_ITERATIONS; i++) {
+#ifdef CONFIG_X86
+        if (cold) {
+            clflush_cache_range((void __force*)inst->pm_table_virt_addr,
+                inst->pm_dram_map_size - inst->pm_dram_map_size_alt);
+
+            if (inst->pm_dram_map_size_alt)
+                clflush_cache_range((void __force*)inst->pm_table_virt_addr_alt, inst->pm_dram_map_size_alt);
+        }
+#endif
+
+        start = ktime_get_ns();
+        smu_copy_pm_table_locked(inst, buff, strategy);
+        total += ktime_get_ns() - start;
+    }
+
+    *ns = div_u64(total, SMU_PM_COPY_BENCH_ITERATIONS);
+
+UNLOCK_PM:
+    mutex_unlock(&inst->pm_lock);
+
+BREAK_OUT:
+    mutex_unlock(&smu_instances_mutex);
+    kfree(buff);
+
+    return ret;
+}
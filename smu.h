@@ -8,6 +8,10 @@
 #include <linux/pci.h>
 #include <linux/printk.h>
 
+#include "ryzen_smu.h"
+#include "smu_codename.h"
+#include "smu_poll.h"
+
 /* Redefine output format for nicer formatting. */
 #ifdef pr_fmt
     #undef pr_fmt
@@ -23,14 +27,32 @@
 /* Maximum size in bytes, of the PM table for any processor codename. */
 #define PM_TABLE_MAX_SIZE                             0x1AB0
 
-/* Specifies the amount of attempts an of polling the SMU for a command response till it fails. */
-#define SMU_RETRIES_MAX                               32768
-#define SMU_RETRIES_MIN                               500
-
 /* PCI Query Registers. [0x60, 0x64] & [0xB4, 0xB8] also work. These may be arch-specific. */
 #define SMU_PCI_ADDR_REG                              0xC4
 #define SMU_PCI_DATA_REG                              0xC8
 
+/**
+ * Alternate PCI Query Registers, used as additional SMN lanes once verified to work.
+ * N.B. [0x60, 0x64] is also used by the kernel's own SMN accessors (amd_smn_read/write) under a
+ *  lock the driver can't take, so it is neither probed nor used unless smn_lanes includes it.
+ */
+#define SMU_PCI_ADDR_REG_ALT1                         0xB4
+#define SMU_PCI_DATA_REG_ALT1                         0xB8
+#define SMU_PCI_ADDR_REG_ALT2                         0x60
+#define SMU_PCI_DATA_REG_ALT2                         0x64
+
+/* Number of index/data register pairs SMN accesses may be spread across. */
+#define SMU_SMN_LANES_MAX                             3
+
+/* Largest read of the PM table copied to userspace through a buffer on the stack. */
+#define SMU_PM_USER_STACK_SIZE                        128
+
+/* Upper bound of the minimum interval between PM table refreshes, in microseconds. */
+#define PM_REFRESH_INTERVAL_MAX_US                    1000000
+
+/* Maximum number of SMUs, one per root complex hosting one, the driver can be bound to. */
+#define SMU_MAX_NODES                                 8
+
 /* Maximum number of 32-bit arguments an SMU command shall have. */
 #define SMU_REQ_MAX_ARGS                              6
 
@@ -60,31 +82,6 @@ enum smu_return_val {
     SMU_Return_PCIFailed         = 0xF6,
 };
 
-/**
- * Supported processor codenames with SMU capabilities.
- */
-enum smu_processor_codename {
-    CODENAME_UNDEFINED,
-    CODENAME_COLFAX,
-    CODENAME_RENOIR,
-    CODENAME_PICASSO,
-    CODENAME_MATISSE,
-    CODENAME_THREADRIPPER,
-    CODENAME_CASTLEPEAK,
-    CODENAME_RAVENRIDGE,
-    CODENAME_RAVENRIDGE2,
-    CODENAME_SUMMITRIDGE,
-    CODENAME_PINNACLERIDGE,
-    CODENAME_REMBRANDT,
-    CODENAME_VERMEER,
-    CODENAME_VANGOGH,
-    CODENAME_CEZANNE,
-    CODENAME_MILAN,
-    CODENAME_DALI,
-
-    CODENAME_COUNT
-};
-
 /**
  * SMU MP1 Interface Version [v9-v13]
  */
@@ -124,19 +121,25 @@ typedef union {
 } smu_req_args_t;
 
 /* Parameters for SMU execution. */
-extern uint smu_timeout_attempts;
+extern uint smu_timeout_us;
+extern uint smn_lanes;
+extern bool smu_cache;
+extern uint pm_refresh_interval_us;
+extern uint pm_copy_strategy;
 
 /**
- * Initializes for SMU use. MUST be called before using any function.
+ * Initializes the SMU of [dev] for use. MUST be called before using any function with [dev].
+ * Each root complex hosting an SMU is initialized separately and can be used independently
+ *  of the others.
  *
  * Returns 0 on success, anything else on failure.
  */
 int smu_init(struct pci_dev* dev);
 
 /**
- * Cleans up the allocated objects after use.
+ * Cleans up the objects allocated for the SMU of [dev] after use.
  */
-void smu_cleanup(void);
+void smu_cleanup(struct pci_dev* dev);
 
 /**
  * Returns the running processor's detected code name.
@@ -151,6 +154,24 @@ enum smu_processor_codename smu_get_codename(void);
 enum smu_return_val smu_read_address(struct pci_dev* dev, u32 address, u32* value);
 enum smu_return_val smu_write_address(struct pci_dev* dev, u32 address, u32 value);
 
+/**
+ * Executes [count] SMN reads or writes in order, under a single acquisition of the SMN lock.
+ * The result of each access is stored in its status and, for reads, value fields.
+ *
+ * Returns SMU_Return_OK if all accesses succeeded, SMU_Return_PCIFailed otherwise.
+ */
+enum smu_return_val smu_smn_rw_batch(struct pci_dev* dev, struct ryzen_smn_op* ops, u32 count);
+
+/**
+ * Reads or writes [count] consecutive 32 bit words starting at [address] from or to [values],
+ *  under a single acquisition of the SMN lock. Stops at the first failed access, the amount of
+ *  words accessed before it being stored in [done].
+ *
+ * Returns an smu_return_val indicating the status of the operation.
+ */
+enum smu_return_val smu_smn_rw_range(struct pci_dev* dev, u32 address, u32* values, u32 count,
+    int write, u32* done);
+
 /**
  * Initializes an SMU REQ ARG structure with zeros.
  * The argument [value] is set as the first argument set for the request.
@@ -163,6 +184,8 @@ void smu_args_init(smu_req_args_t* args, u32 value);
  *   destination.
  *
  * Results are returned in the args array upon a service request being completed.
+ * For commands known to the driver, only the arguments the command uses are sent and only the
+ *   results it produces are returned, leaving the remainder of [args] untouched.
  *
  * Returns an smu_return_val indicating the status of the operation.
  */
@@ -194,11 +217,80 @@ enum smu_return_val smu_transfer_table_to_dram(struct pci_dev* dev);
  */
 enum smu_return_val smu_get_pm_table_version(struct pci_dev* dev, u32* version);
 
+/**
+ * Returns the amount of SMN lanes of [dev] which were verified to work.
+ */
+u32 smu_get_smn_lanes(struct pci_dev* dev);
+
 /**
  * Reads the PM table for the current CPU, if supported, into the destination buffer.
+ * Concurrent readers are coalesced: only one of them commands the SMU to refresh the table while
+ *  the others wait for it and receive the same contents.
+ * The SMU is only commanded to refresh the table if it was last refreshed more than [max_age_us]
+ *  ago, smu_read_pm_table() uses pm_refresh_interval_us.
+ * When [refreshed] isn't NULL, it receives the time at which the SMU was commanded to refresh the
+ *  table that was read, which may be earlier than the read itself.
  *
  * Returns an smu_return_val indicating the status of the operation.
  */
 enum smu_return_val smu_read_pm_table(struct pci_dev* dev, unsigned char* dst, size_t* len);
+enum smu_return_val smu_read_pm_table_aged(struct pci_dev* dev, unsigned char* dst, size_t* len,
+    u32 max_age_us, ktime_t* refreshed);
+
+/**
+ * Ways of copying the PM table out of its mapping, selected by pm_copy_strategy. Which is fastest
+ *  depends on the platform, see smu_bench_pm_table_copy().
+ */
+enum smu_pm_copy_strategy {
+    // memcpy_fromio(), which some architectures implement with small accesses.
+    SMU_PM_COPY_FROMIO,
+
+    // memcpy(), valid as the table is mapped as regular cacheable memory.
+    SMU_PM_COPY_MEMCPY,
+
+    // 64 byte blocks of 64 bit loads when both buffers are aligned, memcpy_fromio() otherwise.
+    SMU_PM_COPY_WIDE,
+
+    SMU_PM_COPY_COUNT
+};
+
+/* Copies of the PM table made by smu_bench_pm_table_copy() for every measurement. */
+#define SMU_PM_COPY_BENCH_ITERATIONS       1000
+
+/**
+ * Measures copying the PM table of the SMU at [index], out of SMU_MAX_NODES, with [strategy],
+ *  averaged over SMU_PM_COPY_BENCH_ITERATIONS copies. When [cold], the mapping is flushed from the
+ *  caches before every copy, as it is after the SMU refreshed the table, on x86. Only the copies are timed
+ *  and the SMU is not commanded to refresh the table unless it never did.
+ * [dev] receives the device of the SMU and [ns] the time per table, in nanoseconds.
+ *
+ * Returns an smu_return_val indicating the status of the operation, SMU_Return_Unsupported if there
+ *  is no SMU at [index].
+ */
+enum smu_return_val smu_bench_pm_table_copy(u32 index, enum smu_pm_copy_strategy strategy, bool cold,
+    struct pci_dev** dev, u64* ns);
+
+/**
+ * Copies up to [len] bytes of the PM table starting at byte [off] into the kernel buffer [dst],
+ *  having the SMU refresh the table if it is older than [max_age_us]. Only the bytes requested are
+ *  copied out of the mapping of the table.
+ * [len] is updated with the amount of bytes copied, 0 past the end of the table.
+ *
+ * Returns an smu_return_val indicating the status of the operation.
+ */
+enum smu_return_val smu_read_pm_table_range(struct pci_dev* dev, u8* dst, loff_t off, size_t* len,
+    u32 max_age_us);
+
+/**
+ * Copies up to [len] bytes of the PM table starting at byte [off] into the userspace buffer [dst],
+ *  refreshing the table as smu_read_pm_table() does. Only the bytes requested are copied out of the
+ *  mapping of the table, through a buffer on the stack for reads of up to SMU_PM_USER_STACK_SIZE.
+ * [len] is updated with the amount of bytes copied, 0 past the end of the table.
+ *
+ * Returns an smu_return_val indicating the status of the operation, SMU_Return_InvalidArgument if
+ *  [dst] could not be written to and SMU_Return_InsufficientSize if no buffer could be allocated.
+ */
+enum smu_return_val smu_read_pm_table_user(struct pci_dev* dev, void __user* dst, loff_t off,
+    size_t* len);
 
 #endif /* __SMU_H__ */
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Processor Codenames */
+
+#ifndef __SMU_CODENAME_H__
+#define __SMU_CODENAME_H__
+
+/* Kept apart from smu.h so that pm_schema.c may be built into userspace tools as well. */
+
+/**
+ * Supported processor codenames with SMU capabilities.
+ */
+enum smu_processor_codename {
+    CODENAME_UNDEFINED,
+    CODENAME_COLFAX,
+    CODENAME_RENOIR,
+    CODENAME_PICASSO,
+    CODENAME_MATISSE,
+    CODENAME_THREADRIPPER,
+    CODENAME_CASTLEPEAK,
+    CODENAME_RAVENRIDGE,
+    CODENAME_RAVENRIDGE2,
+    CODENAME_SUMMITRIDGE,
+    CODENAME_PINNACLERIDGE,
+    CODENAME_REMBRANDT,
+    CODENAME_VERMEER,
+    CODENAME_VANGOGH,
+    CODENAME_CEZANNE,
+    CODENAME_MILAN,
+    CODENAME_DALI,
+
+    CODENAME_COUNT
+};
+
+#endif /* __SMU_CODENAME_H__ */
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Mailbox Polling */
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#else
+#include <limits.h>
+
+#define U32_MAX                         UINT_MAX
+#define min_t(type, x, y)               ((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+#define clamp_val(val, lo, hi)          ((val) < (lo) ? (lo) : (val) > (hi) ? (hi) : (val))
+#define div_u64(x, y)                   ((x) / (y))
+#endif
+
+#include "smu_poll.h"
+
+#define SMU_POLL_NSEC_PER_USEC          1000ULL
+
+u64 smu_poll_deadline(u64 now, u32 timeout_us) {
+    return now + clamp_val(timeout_us, SMU_TIMEOUT_MIN_US, SMU_TIMEOUT_MAX_US) * SMU_POLL_NSEC_PER_USEC;
+}
+
+void smu_poll_init(struct smu_poll* poll, u64 now, u64 deadline) {
+    poll->deadline = deadline;
+    poll->spin_end = now + SMU_POLL_SPIN_US * SMU_POLL_NSEC_PER_USEC;
+    poll->sleep_us = SMU_POLL_SLEEP_MIN_US;
+}
+
+enum smu_poll_step smu_poll_next(struct smu_poll* poll, u64 now, u32* sleep_us) {
+    if (now > poll->deadline)
+        return SMU_POLL_TIMEOUT;
+
+    if (now < poll->spin_end)
+        return SMU_POLL_SPIN;
+
+    *sleep_us = poll->sleep_us;
+    poll->sleep_us = min_t(u32, poll->sleep_us * 2, SMU_POLL_SLEEP_MAX_US);
+
+    return SMU_POLL_SLEEP;
+}
+
+u32 smu_timeout_attempts_to_us(u32 attempts) {
+    return min_t(u64, U32_MAX,
+        div_u64((u64)attempts * SMU_TIMEOUT_DEFAULT_US, SMU_TIMEOUT_ATTEMPTS_DEFAULT));
+}
+
+u32 smu_timeout_us_to_attempts(u32 timeout_us) {
+    return min_t(u64, U32_MAX,
+        div_u64((u64)timeout_us * SMU_TIMEOUT_ATTEMPTS_DEFAULT, SMU_TIMEOUT_DEFAULT_US));
+}
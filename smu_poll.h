@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Mailbox Polling */
+
+#ifndef __SMU_POLL_H__
+#define __SMU_POLL_H__
+
+/**
+ * Decides when the response register of a mailbox is polled and when a command has timed out,
+ *  given the current time, as well as converting the deprecated timeout parameter.
+ *
+ * This has no dependencies on the kernel so that it may be built into userspace tools as well, e.g.
+ *  to run the polling against an emulated mailbox.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+
+typedef uint32_t           u32;
+typedef unsigned long long u64;
+#endif
+
+/* Bounds, in microseconds, of how long an SMU command may take before it is considered failed. */
+#define SMU_TIMEOUT_MAX_US                            1000000
+#define SMU_TIMEOUT_MIN_US                            500
+#define SMU_TIMEOUT_DEFAULT_US                        20000
+
+/* Default of the deprecated smu_timeout_attempts parameter, equivalent to SMU_TIMEOUT_DEFAULT_US. */
+#define SMU_TIMEOUT_ATTEMPTS_DEFAULT                  8192
+
+/* Time spent busy-polling the SMU for a response before sleeping in-between polls. */
+#define SMU_POLL_SPIN_US                              20
+
+/* Bounds of the sleep between polls. The interval doubles after each unanswered poll. */
+#define SMU_POLL_SLEEP_MIN_US                         10
+#define SMU_POLL_SLEEP_MAX_US                         1000
+
+enum smu_poll_step {
+    SMU_POLL_SPIN,
+    SMU_POLL_SLEEP,
+    SMU_POLL_TIMEOUT,
+};
+
+/**
+ * State of a single wait for a response. Times are in nanoseconds of a monotonic clock.
+ */
+struct smu_poll {
+    u64                        deadline;
+    u64                        spin_end;
+    u32                        sleep_us;
+};
+
+/**
+ * Returns the deadline, at [now], of an exchange with a timeout of [timeout_us], which is clamped
+ *  to the supported bounds. The deadline covers every wait of the exchange.
+ */
+u64 smu_poll_deadline(u64 now, u32 timeout_us);
+
+/**
+ * Starts a wait, at [now], for a response due by [deadline].
+ */
+void smu_poll_init(struct smu_poll* poll, u64 now, u64 deadline);
+
+/**
+ * Decides what to do, at [now], after a poll found no response. When sleeping, the sleep should
+ *  last between [sleep_us] and twice as long.
+ * The deadline is only reported as passed once the register was polled after it, so oversleeping
+ *  can never cause a command that did complete to be reported as timed out.
+ */
+enum smu_poll_step smu_poll_next(struct smu_poll* poll, u64 now, u32* sleep_us);
+
+/**
+ * Converts between the deprecated smu_timeout_attempts and smu_timeout_us, with the default
+ *  amount of attempts corresponding to the default timeout. Saturates rather than overflowing.
+ */
+u32 smu_timeout_attempts_to_us(u32 attempts);
+u32 smu_timeout_us_to_attempts(u32 timeout_us);
+
+#endif /* __SMU_POLL_H__ */
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Tracepoints */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ryzen_smu
+
+#if !defined(__SMU_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __SMU_TRACE_H__
+
+#include <linux/pci.h>
+#include <linux/tracepoint.h>
+
+/**
+ * Tracepoints of the SMU layer, available under events/ryzen_smu for ftrace, perf and bpftrace.
+ * Disabled tracepoints only cost a patched out branch, timestamps needed solely for tracing are
+ *  only taken while the respective tracepoint is enabled.
+ */
+
+#define show_smu_mailbox(mb) __print_symbolic(mb, { 0, "rsmu" }, { 1, "mp1" })
+
+TRACE_EVENT(smu_cmd_start,
+    TP_PROTO(struct pci_dev* dev, u32 mailbox, u32 op, const u32* args),
+
+    TP_ARGS(dev, mailbox, op, args),
+
+    TP_STRUCT__entry(
+        __field(u8,     bus)
+        __field(u32,    mailbox)
+        __field(u32,    op)
+        __array(u32,    args, 6)
+    ),
+
+    TP_fast_assign(
+        __entry->bus     = dev->bus->number;
+        __entry->mailbox = mailbox;
+        __entry->op      = op;
+        memcpy(__entry->args, args, sizeof(__entry->args));
+    ),
+
+    TP_printk("bus=%02x mailbox=%s op=0x%02x args=[%08x %08x %08x %08x %08x %08x]",
+        __entry->bus, show_smu_mailbox(__entry->mailbox), __entry->op,
+        __entry->args[0], __entry->args[1], __entry->args[2],
+        __entry->args[3], __entry->args[4], __entry->args[5])
+);
+
+TRACE_EVENT(smu_cmd_end,
+    TP_PROTO(struct pci_dev* dev, u32 mailbox, u32 op, const u32* args, u32 ret, u32 polls,
+        u64 latency_ns),
+
+    TP_ARGS(dev, mailbox, op, args, ret, polls, latency_ns),
+
+    TP_STRUCT__entry(
+        __field(u8,     bus)
+        __field(u32,    mailbox)
+        __field(u32,    op)
+        __array(u32,    args, 6)
+        __field(u32,    ret)
+        __field(u32,    polls)
+        __field(u64,    latency_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->bus        = dev->bus->number;
+        __entry->mailbox    = mailbox;
+        __entry->op         = op;
+        memcpy(__entry->args, args, sizeof(__entry->args));
+        __entry->ret        = ret;
+        __entry->polls      = polls;
+        __entry->latency_ns = latency_ns;
+    ),
+
+    TP_printk("bus=%02x mailbox=%s op=0x%02x ret=0x%02x polls=%u latency_ns=%llu "
+        "args=[%08x %08x %08x %08x %08x %08x]",
+        __entry->bus, show_smu_mailbox(__entry->mailbox), __entry->op, __entry->ret,
+        __entry->polls, __entry->latency_ns,
+        __entry->args[0], __entry->args[1], __entry->args[2],
+        __entry->args[3], __entry->args[4], __entry->args[5])
+);
+
+TRACE_EVENT(smu_smn_access,
+    TP_PROTO(struct pci_dev* dev, u32 address, u32 value, int write, int err, u64 latency_ns),
+
+    TP_ARGS(dev, address, value, write, err, latency_ns),
+
+    TP_STRUCT__entry(
+        __field(u8,     bus)
+        __field(u32,    address)
+        __field(u32,    value)
+        __field(int,    write)
+        __field(int,    err)
+        __field(u64,    latency_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->bus        = dev->bus->number;
+        __entry->address    = address;
+        __entry->value      = value;
+        __entry->write      = write;
+        __entry->err        = err;
+        __entry->latency_ns = latency_ns;
+    ),
+
+    TP_printk("bus=%02x %s address=0x%08x value=0x%08x err=%d latency_ns=%llu",
+        __entry->bus, __entry->write ? "write" : "read", __entry->address, __entry->value,
+        __entry->err, __entry->latency_ns)
+);
+
+TRACE_EVENT(smu_pm_table_transfer,
+    TP_PROTO(struct pci_dev* dev, u32 ret, u64 latency_ns),
+
+    TP_ARGS(dev, ret, latency_ns),
+
+    TP_STRUCT__entry(
+        __field(u8,     bus)
+        __field(u32,    ret)
+        __field(u64,    latency_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->bus        = dev->bus->number;
+        __entry->ret        = ret;
+        __entry->latency_ns = latency_ns;
+    ),
+
+    TP_printk("bus=%02x ret=0x%02x latency_ns=%llu",
+        __entry->bus, __entry->ret, __entry->latency_ns)
+);
+
+TRACE_EVENT(smu_pm_table_copy,
+    TP_PROTO(struct pci_dev* dev, u32 size, u64 latency_ns),
+
+    TP_ARGS(dev, size, latency_ns),
+
+    TP_STRUCT__entry(
+        __field(u8,     bus)
+        __field(u32,    size)
+        __field(u64,    latency_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->bus        = dev->bus->number;
+        __entry->size       = size;
+        __entry->latency_ns = latency_ns;
+    ),
+
+    TP_printk("bus=%02x size=%u latency_ns=%llu",
+        __entry->bus, __entry->size, __entry->latency_ns)
+);
+
+#endif /* __SMU_TRACE_H__ */
+
+/* This part must be outside the include guard. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE smu_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,402 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Command Statistics */
+
+#include <linux/module.h>
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include "stats.h"
+
+struct smu_stats_entry {
+    atomic64_t                     count;
+    atomic64_t                     total_ns;
+    atomic64_t                     max_ns;
+    atomic64_t                     polls;
+
+    atomic64_t                     timeouts;
+    atomic64_t                     busy;
+    atomic64_t                     failed;
+
+    atomic64_t                     lat_hist[SMU_STATS_LAT_BUCKETS];
+    atomic64_t                     poll_hist[SMU_STATS_POLL_BUCKETS];
+};
+
+struct smu_stats {
+    // One entry per tracked command ID followed by the totals of the mailbox.
+    struct smu_stats_entry         cmds[MAILBOX_TYPE_COUNT][SMU_STATS_MAX_OP + 2];
+
+    atomic64_t                     cache[SMU_STATS_CACHE_COUNT];
+};
+
+/**
+ * SMN access statistics of a single CPU. SMN accesses are spread across several lanes from any CPU,
+ *  shared counters would have every access contend for the same cache line.
+ */
+struct smu_stats_smn_cpu {
+    u64                            count;
+    u64                            total_ns;
+    u64                            max_ns;
+    u64                            failed;
+
+    u64                            lat_hist[SMU_STATS_LAT_BUCKETS];
+};
+
+#define SMU_STATS_TOTAL                    (SMU_STATS_MAX_OP + 1)
+
+static struct smu_stats* smu_stats = NULL;
+static struct smu_stats_smn_cpu __percpu* smu_stats_smn_cpu = NULL;
+static struct dentry* smu_stats_dir = NULL;
+
+static const char* const smu_stats_mailbox_names[MAILBOX_TYPE_COUNT] = {
+    "rsmu",
+    "mp1",
+};
+
+static u32 smu_stats_bucket(u64 value, u32 buckets) {
+    return min_t(u32, fls64(value), buckets - 1);
+}
+
+static void smu_stats_update_max(atomic64_t* max, u64 value) {
+    s64 cur = atomic64_read(max);
+
+    while ((u64)cur < value) {
+        s64 old = atomic64_cmpxchg(max, cur, value);
+
+        if (old == cur)
+            break;
+
+        cur = old;
+    }
+}
+
+static void smu_stats_record(struct smu_stats_entry* entry, enum smu_return_val ret, u64 ns,
+    u32 polls) {
+    atomic64_inc(&entry->count);
+    atomic64_add(ns, &entry->total_ns);
+    atomic64_add(polls, &entry->polls);
+    smu_stats_update_max(&entry->max_ns, ns);
+
+    atomic64_inc(&entry->lat_hist[smu_stats_bucket(ns, SMU_STATS_LAT_BUCKETS)]);
+    atomic64_inc(&entry->poll_hist[smu_stats_bucket(polls, SMU_STATS_POLL_BUCKETS)]);
+
+    switch (ret) {
+        case SMU_Return_OK:
+            break;
+        case SMU_Return_CommandTimeout:
+            atomic64_inc(&entry->timeouts);
+            break;
+        case SMU_Return_CmdRejectedBusy:
+            atomic64_inc(&entry->busy);
+            break;
+        default:
+            atomic64_inc(&entry->failed);
+            break;
+    }
+}
+
+void smu_stats_command(enum smu_mailbox mailbox, u32 op, enum smu_return_val ret, u64 ns, u32 polls) {
+    struct smu_stats* stats = READ_ONCE(smu_stats);
+
+    if (!stats || mailbox >= MAILBOX_TYPE_COUNT)
+        return;
+
+    if (op <= SMU_STATS_MAX_OP)
+        smu_stats_record(&stats->cmds[mailbox][op], ret, ns, polls);
+
+    smu_stats_record(&stats->cmds[mailbox][SMU_STATS_TOTAL], ret, ns, polls);
+}
+
+void smu_stats_smn(u64 ns, int failed) {
+    struct smu_stats_smn_cpu __percpu* pcpu = READ_ONCE(smu_stats_smn_cpu);
+    struct smu_stats_smn_cpu* stats;
+
+    if (!pcpu)
+        return;
+
+    // SMN accesses are made from process context only, so disabling preemption is enough.
+    stats = get_cpu_ptr(pcpu);
+
+    stats->count++;
+    stats->total_ns += ns;
+    stats->max_ns = max(stats->max_ns, ns);
+    stats->failed += !!failed;
+    stats->lat_hist[smu_stats_bucket(ns, SMU_STATS_LAT_BUCKETS)]++;
+
+    put_cpu_ptr(pcpu);
+}
+
+// Sums the SMN statistics of every CPU, racing updates may be partially included.
+static void smu_stats_smn_sum(struct smu_stats_smn_cpu* sum) {
+    struct smu_stats_smn_cpu* stats;
+    int cpu;
+    u32 i;
+
+    memset(sum, 0, sizeof(*sum));
+
+    for_each_possible_cpu(cpu) {
+        stats = per_cpu_ptr(smu_stats_smn_cpu, cpu);
+
+        sum->count += READ_ONCE(stats->count);
+        sum->total_ns += READ_ONCE(stats->total_ns);
+        sum->max_ns = max(sum->max_ns, READ_ONCE(stats->max_ns));
+        sum->failed += READ_ONCE(stats->failed);
+
+        for (i = 0; i < SMU_STATS_LAT_BUCKETS; i++)
+            sum->lat_hist[i] += READ_ONCE(stats->lat_hist[i]);
+    }
+}
+
+void smu_stats_cache(enum smu_stats_cache_event event) {
+    struct smu_stats* stats = READ_ONCE(smu_stats);
+
+    if (!stats || event >= SMU_STATS_CACHE_COUNT)
+        return;
+
+    atomic64_inc(&stats->cache[event]);
+}
+
+static void smu_stats_show_summary(struct seq_file* m, const char* mailbox, const char* op,
+    struct smu_stats_entry* entry) {
+    u64 count = atomic64_read(&entry->count);
+
+    seq_printf(m, "%-6s %-6s %10llu %12llu %12llu %10llu %8llu %8llu %8llu\n",
+        mailbox, op, count,
+        count ? (u64)atomic64_read(&entry->total_ns) / count : 0,
+        (u64)atomic64_read(&entry->max_ns),
+        count ? (u64)atomic64_read(&entry->polls) / count : 0,
+        (u64)atomic64_read(&entry->timeouts),
+        (u64)atomic64_read(&entry->busy),
+        (u64)atomic64_read(&entry->failed));
+}
+
+static int smu_stats_commands_show(struct seq_file* m, void* v) {
+    struct smu_stats_entry* entry;
+    char op[8];
+    u32 i, j;
+
+    seq_printf(m, "%-6s %-6s %10s %12s %12s %10s %8s %8s %8s\n",
+        "mbox", "op", "count", "avg_ns", "max_ns", "avg_polls", "timeout", "busy", "failed");
+
+    for (i = 0; i < MAILBOX_TYPE_COUNT; i++) {
+        for (j = 0; j <= SMU_STATS_MAX_OP; j++) {
+            entry = &smu_stats->cmds[i][j];
+
+            if (!atomic64_read(&entry->count))
+                continue;
+
+            snprintf(op, sizeof(op), "0x%02X", j);
+            smu_stats_show_summary(m, smu_stats_mailbox_names[i], op, entry);
+        }
+
+        smu_stats_show_summary(m, smu_stats_mailbox_names[i], "all",
+            &smu_stats->cmds[i][SMU_STATS_TOTAL]);
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(smu_stats_commands);
+
+static void smu_stats_show_hist(struct seq_file* m, const char* mailbox, const char* op,
+    atomic64_t* hist, u32 buckets) {
+    u32 i;
+
+    seq_printf(m, "%-6s %-6s", mailbox, op);
+
+    for (i = 0; i < buckets; i++)
+        seq_printf(m, " %llu", (u64)atomic64_read(&hist[i]));
+
+    seq_putc(m, '\n');
+}
+
+static void smu_stats_show_hists(struct seq_file* m, int latency) {
+    struct smu_stats_smn_cpu smn;
+    struct smu_stats_entry* entry;
+    u32 i, j, buckets;
+    char op[8];
+
+    buckets = latency ? SMU_STATS_LAT_BUCKETS : SMU_STATS_POLL_BUCKETS;
+
+    // Bucket N counts values in [2^(N-1), 2^N), bucket 0 only counts 0.
+    seq_printf(m, "# log2 buckets of %s, bucket N covers [2^(N-1), 2^N)\n",
+        latency ? "nanoseconds" : "RSP polls");
+
+    for (i = 0; i < MAILBOX_TYPE_COUNT; i++) {
+        for (j = 0; j <= SMU_STATS_MAX_OP + 1; j++) {
+            entry = &smu_stats->cmds[i][j];
+
+            if (!atomic64_read(&entry->count))
+                continue;
+
+            if (j == SMU_STATS_TOTAL)
+                snprintf(op, sizeof(op), "all");
+            else
+                snprintf(op, sizeof(op), "0x%02X", j);
+
+            smu_stats_show_hist(m, smu_stats_mailbox_names[i], op,
+                latency ? entry->lat_hist : entry->poll_hist, buckets);
+        }
+    }
+
+    if (!latency)
+        return;
+
+    smu_stats_smn_sum(&smn);
+    if (!smn.count)
+        return;
+
+    seq_printf(m, "%-6s %-6s", "smn", "all");
+
+    for (i = 0; i < buckets; i++)
+        seq_printf(m, " %llu", smn.lat_hist[i]);
+
+    seq_putc(m, '\n');
+}
+
+static int smu_stats_latency_show(struct seq_file* m, void* v) {
+    smu_stats_show_hists(m, 1);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(smu_stats_latency);
+
+static int smu_stats_polls_show(struct seq_file* m, void* v) {
+    smu_stats_show_hists(m, 0);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(smu_stats_polls);
+
+static int smu_stats_smn_show(struct seq_file* m, void* v) {
+    struct smu_stats_smn_cpu smn;
+
+    smu_stats_smn_sum(&smn);
+
+    seq_printf(m, "count:  %llu\n", smn.count);
+    seq_printf(m, "failed: %llu\n", smn.failed);
+    seq_printf(m, "avg_ns: %llu\n", smn.count ? smn.total_ns / smn.count : 0);
+    seq_printf(m, "max_ns: %llu\n", smn.max_ns);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(smu_stats_smn);
+
+static int smu_stats_cache_show(struct seq_file* m, void* v) {
+    seq_printf(m, "hits:          %llu\n",
+        (u64)atomic64_read(&smu_stats->cache[SMU_STATS_CACHE_HIT]));
+    seq_printf(m, "misses:        %llu\n",
+        (u64)atomic64_read(&smu_stats->cache[SMU_STATS_CACHE_MISS]));
+    seq_printf(m, "invalidations: %llu\n",
+        (u64)atomic64_read(&smu_stats->cache[SMU_STATS_CACHE_INVALIDATE]));
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(smu_stats_cache);
+
+static const char* smu_stats_copy_names[SMU_PM_COPY_COUNT] = {
+    [SMU_PM_COPY_FROMIO] = "fromio",
+    [SMU_PM_COPY_MEMCPY] = "memcpy",
+    [SMU_PM_COPY_WIDE]   = "wide",
+};
+
+// Runs the PM table copy benchmark of every SMU whenever read.
+static int smu_stats_pm_copy_bench_show(struct seq_file* m, void* v) {
+    enum smu_return_val ret;
+    struct pci_dev* dev;
+    u64 hot, cold;
+    u32 i, j;
+
+    seq_printf(m, "%-14s %-8s %10s %10s\n", "device", "strategy", "hot_ns", "cold_ns");
+
+    for (i = 0; i < SMU_MAX_NODES; i++) {
+        for (j = 0; j < SMU_PM_COPY_COUNT; j++) {
+            ret = smu_bench_pm_table_copy(i, j, false, &dev, &hot);
+            if (ret == SMU_Return_OK)
+                ret = smu_bench_pm_table_copy(i, j, true, &dev, &cold);
+
+            // Empty slot, no need to try the other strategies.
+            if (ret == SMU_Return_Unsupported)
+                break;
+
+            if (ret != SMU_Return_OK) {
+                seq_printf(m, "%-14s %-8s failed (%d)\n", pci_name(dev), smu_stats_copy_names[j], ret);
+                break;
+            }
+
+            seq_printf(m, "%-14s %-8s %10llu %10llu%s\n", pci_name(dev), smu_stats_copy_names[j],
+                hot, cold, j == READ_ONCE(pm_copy_strategy) ? " *" : "");
+        }
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(smu_stats_pm_copy_bench);
+
+static ssize_t smu_stats_reset_write(struct file* filp, const char __user* buf, size_t count,
+    loff_t* ppos) {
+    int cpu;
+
+    // Racing updates may be partially retained, which is acceptable for statistics.
+    memset(smu_stats, 0, sizeof(*smu_stats));
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(smu_stats_smn_cpu, cpu), 0, sizeof(struct smu_stats_smn_cpu));
+
+    return count;
+}
+
+static const struct file_operations smu_stats_reset_fops = {
+    .owner          = THIS_MODULE,
+    .write          = smu_stats_reset_write,
+};
+
+int smu_stats_init(void) {
+    struct smu_stats* stats;
+
+    // Consider it initialized in case it is called twice.
+    if (smu_stats)
+        return 0;
+
+    stats = vzalloc(sizeof(*stats));
+    if (!stats)
+        return -ENOMEM;
+
+    smu_stats_smn_cpu = alloc_percpu(struct smu_stats_smn_cpu);
+    if (!smu_stats_smn_cpu) {
+        vfree(stats);
+        return -ENOMEM;
+    }
+
+    smu_stats_dir = debugfs_create_dir("ryzen_smu", NULL);
+
+    debugfs_create_file("commands", S_IRUSR, smu_stats_dir, NULL, &smu_stats_commands_fops);
+    debugfs_create_file("latency_hist", S_IRUSR, smu_stats_dir, NULL, &smu_stats_latency_fops);
+    debugfs_create_file("polls_hist", S_IRUSR, smu_stats_dir, NULL, &smu_stats_polls_fops);
+    debugfs_create_file("smn", S_IRUSR, smu_stats_dir, NULL, &smu_stats_smn_fops);
+    debugfs_create_file("cache", S_IRUSR, smu_stats_dir, NULL, &smu_stats_cache_fops);
+    debugfs_create_file("reset", S_IWUSR, smu_stats_dir, NULL, &smu_stats_reset_fops);
+    debugfs_create_file("pm_copy_bench", S_IRUSR, smu_stats_dir, NULL, &smu_stats_pm_copy_bench_fops);
+
+    WRITE_ONCE(smu_stats, stats);
+
+    return 0;
+}
+
+void smu_stats_cleanup(void) {
+    struct smu_stats_smn_cpu __percpu* smn = smu_stats_smn_cpu;
+    struct smu_stats* stats = smu_stats;
+
+    // Only called once every device was unbound, so nothing records anymore.
+    debugfs_remove_recursive(smu_stats_dir);
+    smu_stats_dir = NULL;
+
+    WRITE_ONCE(smu_stats_smn_cpu, NULL);
+
+    WRITE_ONCE(smu_stats, NULL);
+    vfree(stats);
+
+    free_percpu(smn);
+}
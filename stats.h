@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com> */
+/* Ryzen SMU Command Statistics */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <linux/types.h>
+
+#include "smu.h"
+
+/**
+ * Collects latency and polling statistics of SMU commands and SMN accesses, exposed under
+ *  /sys/kernel/debug/ryzen_smu. Recording only uses atomic counters so it may be done from any
+ *  context without taking locks, except for SMN accesses which are frequent enough to be counted
+ *  per CPU and must be recorded from process context.
+ */
+
+/* Number of log2 latency buckets. Bucket 0 holds 0 ns, bucket N holds [2^(N-1), 2^N) ns. */
+#define SMU_STATS_LAT_BUCKETS                         32
+
+/* Number of log2 buckets for the amount of times the RSP register was polled by a command. */
+#define SMU_STATS_POLL_BUCKETS                        16
+
+/* Commands are tracked individually up to this ID, higher IDs only count towards the mailbox. */
+#define SMU_STATS_MAX_OP                              0xFF
+
+/**
+ * Allocates the counters and creates the debugfs files or removes them.
+ *
+ * Returns 0 on success, anything else on failure. The driver remains usable on failure.
+ */
+int smu_stats_init(void);
+void smu_stats_cleanup(void);
+
+/**
+ * Records a command executed on [mailbox] which took [ns] nanoseconds, including waiting for the
+ *  mailbox, and polled the RSP register [polls] times before completing with [ret].
+ */
+void smu_stats_command(enum smu_mailbox mailbox, u32 op, enum smu_return_val ret, u64 ns, u32 polls);
+
+/**
+ * Outcomes of looking up an SMU command in the result cache.
+ */
+enum smu_stats_cache_event {
+    SMU_STATS_CACHE_HIT,
+    SMU_STATS_CACHE_MISS,
+    SMU_STATS_CACHE_INVALIDATE,
+
+    SMU_STATS_CACHE_COUNT
+};
+
+/**
+ * Records a result cache lookup or the invalidation of a cached result.
+ */
+void smu_stats_cache(enum smu_stats_cache_event event);
+
+/**
+ * Records an SMN access which took [ns] nanoseconds, including waiting for an SMN lane.
+ */
+void smu_stats_smn(u64 ns, int failed);
+
+#endif /* __STATS_H__ */
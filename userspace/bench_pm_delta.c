@@ -0,0 +1,153 @@
+/**
+ * Ryzen SMU PM Table History Benchmark
+ * Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com>
+ *
+ * This program is free software: you can redistribute it &&/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+// Replays PM table dumps, as written by scripts/dump_pm_table.py, through the delta compressed
+//  history used by the driver and reports the compression ratio and decoding throughput.
+
+#define _GNU_SOURCE
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pm_delta.h>
+
+// One minute of samples at 1 kHz.
+#define SAMPLES                         60000
+
+// Largest PM table supported by the driver, see PM_TABLE_MAX_SIZE.
+#define MAX_TABLE_SIZE                  0x1AB0
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int read_dump(const char* path, u32* table, u32* size) {
+    FILE* fp;
+    size_t len;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 0;
+    }
+
+    len = fread(table, 1, MAX_TABLE_SIZE, fp);
+    fclose(fp);
+
+    if (!len || len % sizeof(u32) || (*size && len != *size)) {
+        fprintf(stderr, "Dump %s has an invalid size of %zu bytes\n", path, len);
+        return 0;
+    }
+
+    *size = len;
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    struct pm_delta_history hist;
+    struct pm_delta_cursor cur;
+    u64 oldest, seq, stored, changed;
+    u32 size = 0, count, i;
+    double start, elapsed;
+    size_t mem_size;
+    u32* tables;
+    void* mem;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <dump> [dump ...]\n", argv[0]);
+        fprintf(stderr, "Dumps are replayed in order, repeating them until %d samples were appended.\n", SAMPLES);
+        return 1;
+    }
+
+    count = argc - 1;
+    tables = malloc((size_t)count * MAX_TABLE_SIZE);
+
+    for (i = 0; i < count; i++) {
+        if (!read_dump(argv[i + 1], tables + (size_t)i * MAX_TABLE_SIZE / sizeof(u32), &size))
+            return 2;
+    }
+
+    mem_size = pm_delta_mem_size(size, SAMPLES);
+    mem = malloc(mem_size);
+
+    if (!mem || pm_delta_init(&hist, mem, mem_size, size)) {
+        fprintf(stderr, "Unable to set up a history of %d samples\n", SAMPLES);
+        return 3;
+    }
+
+    cur.table = malloc(size);
+
+    start = now_ns();
+    for (i = 0; i < SAMPLES; i++)
+        pm_delta_append(&hist, tables + (size_t)(i % count) * MAX_TABLE_SIZE / sizeof(u32), i * 1000000ULL);
+    elapsed = now_ns() - start;
+
+    oldest = pm_delta_oldest(&hist);
+
+    for (i = 0, stored = 0; i < hist.seg_count; i++)
+        stored += hist.segs[i].used;
+
+    printf("Table size:       %u bytes, %u dumps\n", size, count);
+    printf("Samples held:     %llu of %d (%zu bytes allocated)\n",
+        (unsigned long long)(hist.next_seq - oldest), SAMPLES, mem_size);
+    printf("Compression:      %llu bytes raw, %llu bytes stored, ratio %.2f\n",
+        (unsigned long long)((hist.next_seq - oldest) * size), (unsigned long long)stored,
+        (double)(hist.next_seq - oldest) * size / stored);
+    printf("Append:           %.0f ns/sample\n", elapsed / SAMPLES);
+
+    // Full reconstruction of every sample, as done by drains.
+    pm_delta_seek(&hist, &cur, 0);
+
+    start = now_ns();
+    for (seq = 0; pm_delta_next(&hist, &cur); seq++);
+    elapsed = now_ns() - start;
+
+    printf("Decode:           %.0f ns/sample, %.1f MB/s of tables\n",
+        elapsed / seq, seq * size / (elapsed / 1e9) / 1e6);
+
+    // Consumers only following changes read the values straight from the history.
+    pm_delta_seek(&hist, &cur, 0);
+
+    for (changed = 0; pm_delta_next(&hist, &cur);)
+        changed += cur.changed;
+
+    printf("Changed words:    %.1f per sample\n", (double)changed / seq);
+
+    // Random access has to rebuild the sample from the keyframe of its segment.
+    srand(1);
+
+    start = now_ns();
+    for (i = 0; i < 10000; i++) {
+        pm_delta_seek(&hist, &cur, oldest + rand() % (hist.next_seq - oldest));
+        pm_delta_next(&hist, &cur);
+    }
+    elapsed = now_ns() - start;
+
+    printf("Random access:    %.0f ns/sample\n", elapsed / 10000);
+
+    free(cur.table);
+    free(mem);
+    free(tables);
+
+    return 0;
+}
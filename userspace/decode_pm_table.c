@@ -0,0 +1,202 @@
+/**
+ * Ryzen SMU PM Table Decoder
+ * Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+// Decodes a PM table dump, as written by scripts/dump_pm_table.py, through the schemas used by the
+//  driver for the pm_fields, hwmon and perf interfaces. Every value is also converted with the FPU
+//  and compared against the fixed point conversion of the driver, which reports mismatches.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <pm_schema.h>
+
+// Largest PM table supported by the driver, see PM_TABLE_MAX_SIZE.
+#define MAX_TABLE_SIZE                  0x1AB0
+
+static u32 table[MAX_TABLE_SIZE / sizeof(u32)];
+
+static const struct pm_schema* find_schema(u32 version) {
+    const struct pm_schema* schema;
+    u32 i;
+
+    for (i = 0; i < CODENAME_COUNT; i++) {
+        schema = pm_schema_find(i, version);
+        if (schema)
+            return schema;
+    }
+
+    return NULL;
+}
+
+// Same units as the hwmon channels: microwatts for power, thousandths for everything else.
+static u32 unit_scale(const struct pm_field* field) {
+    return strcmp(field->unit, "W") ? 1000 : 1000000;
+}
+
+// Conversion of [raw] by pm_field_scale(), done with the FPU instead.
+static int reference_scale(const struct pm_field* field, u32 raw, u32 scale, long* value) {
+    double scaled;
+    float f;
+
+    if (field->type != PM_FIELD_F32) {
+        scaled = (double)raw * scale;
+    }
+    else {
+        memcpy(&f, &raw, sizeof(f));
+
+        if (!isfinite(f))
+            return -1;
+
+        // Exact in a double, as the mantissa of a float and the scale each fit in 32 bits.
+        scaled = (double)f * scale;
+    }
+
+    if (scaled >= 0x1p63)
+        *value = LONG_MAX;
+    else if (scaled <= -0x1p63)
+        *value = -LONG_MAX;
+    else
+        *value = lround(scaled);
+
+    return 0;
+}
+
+// Formatting of [raw] by pm_field_format(), done with the FPU instead. Halves are rounded up like
+//  the driver does, where printf() would round them to even.
+static void reference_format(const struct pm_field* field, u32 raw, char* buf, size_t size) {
+    double milli, whole;
+    float f;
+
+    if (field->type != PM_FIELD_F32) {
+        snprintf(buf, size, "%u", raw);
+        return;
+    }
+
+    memcpy(&f, &raw, sizeof(f));
+
+    if (!isfinite(f)) {
+        snprintf(buf, size, "%s", isnan(f) ? "nan" : f < 0 ? "-inf" : "inf");
+        return;
+    }
+
+    milli = floor(fabs((double)f) * 1000 + 0.5);
+
+    if (milli < 0x1p64) {
+        snprintf(buf, size, "%s%.0f.%03.0f", f < 0 && milli ? "-" : "", floor(milli / 1000),
+            fmod(milli, 1000));
+        return;
+    }
+
+    whole = fabs((double)f);
+    snprintf(buf, size, "%s%llu.000", f < 0 ? "-" : "",
+        whole < 0x1p64 ? (unsigned long long)whole : ULLONG_MAX);
+}
+
+int main(int argc, char** argv) {
+    const struct pm_schema* schema;
+    const struct pm_field* field;
+    u32 version, size, offset, raw, scale, i, j, mismatches = 0;
+    long value, expected = 0;
+    int err, ref_err;
+    char buf[64], ref[64];
+    size_t len;
+    FILE* fp;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <version> <dump>\n", argv[0]);
+        fprintf(stderr, "The version is that of the PM table, e.g. 0x240903.\n");
+        return 1;
+    }
+
+    version = strtoul(argv[1], NULL, 0);
+
+    schema = find_schema(version);
+    if (!schema) {
+        fprintf(stderr, "No schema for PM table version 0x%06X\n", version);
+        return 2;
+    }
+
+    fp = fopen(argv[2], "rb");
+    if (!fp) {
+        fprintf(stderr, "Unable to open %s\n", argv[2]);
+        return 2;
+    }
+
+    len = fread(table, 1, sizeof(table), fp);
+    fclose(fp);
+
+    if (!len || len % sizeof(u32)) {
+        fprintf(stderr, "Dump %s has an invalid size of %zu bytes\n", argv[2], len);
+        return 2;
+    }
+
+    size = len;
+
+    for (i = 0; i < schema->field_count; i++) {
+        field = &schema->fields[i];
+        scale = unit_scale(field);
+
+        for (j = 0; j < field->count; j++) {
+            offset = field->offset + j * sizeof(u32);
+
+            if (offset + sizeof(u32) > size) {
+                fprintf(stderr, "Field %s at 0x%03X is past the end of the dump\n", field->name, offset);
+                return 2;
+            }
+
+            raw = table[offset / sizeof(u32)];
+
+            pm_field_format(field, raw, buf);
+            buf[strcspn(buf, "\n")] = '\0';
+
+            err = pm_field_scale(field, raw, scale, &value);
+            ref_err = reference_scale(field, raw, scale, &expected);
+
+            if (field->count > 1)
+                printf("%-22s%-3u", field->name, j);
+            else
+                printf("%-25s", field->name);
+
+            printf(" 0x%03X %-4s %14s %16ld", offset, field->unit, buf, err ? 0 : value);
+
+            reference_format(field, raw, ref, sizeof(ref));
+
+            if (!err != !ref_err || (!err && value != expected)) {
+                printf("  MISMATCH, expected %ld", expected);
+                mismatches++;
+            }
+
+            if (strcmp(buf, ref)) {
+                printf("  MISMATCH, expected %s", ref);
+                mismatches++;
+            }
+
+            printf("\n");
+        }
+    }
+
+    if (mismatches) {
+        fprintf(stderr, "%u values were converted incorrectly\n", mismatches);
+        return 3;
+    }
+
+    return 0;
+}
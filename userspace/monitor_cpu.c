@@ -37,8 +37,16 @@
 #define PROGRAM_VERSION                 "1.0"
 #define PM_TABLE_SUPPORTED_VERSION      0x240903
 
-#define READ_SMN_V1(offs) { if (smu_read_smn_addr(&obj, offs + offset, &value1) != SMU_Return_OK) goto _READ_ERROR; }
-#define READ_SMN_V2(offs) { if (smu_read_smn_addr(&obj, offs + offset, &value2) != SMU_Return_OK) goto _READ_ERROR; }
+#define READ_SMN_V1(offs) { if (!get_timing_reg(timings, offs + offset, &value1)) goto _READ_ERROR; }
+#define READ_SMN_V2(offs) { if (!get_timing_reg(timings, offs + offset, &value2)) goto _READ_ERROR; }
+
+// UMC registers read by print_memory_timings(), relative to the channel offset.
+static const unsigned int timing_regs[] = {
+    0x50050, 0x50058, 0x500D0, 0x500D4, 0x50200, 0x50204, 0x50208, 0x5020C, 0x50210,
+    0x50214, 0x50218, 0x50220, 0x50224, 0x50228, 0x50254, 0x50260, 0x50264,
+};
+
+#define TIMING_REGS_COUNT               (sizeof(timing_regs) / sizeof(timing_regs[0]))
 
 // Ryzen 3700X/3800X
 typedef struct {
@@ -212,13 +220,38 @@ typedef struct {
 static smu_obj_t obj;
 static int update_time_s = 1;
 
+int get_timing_reg(smu_smn_op_t* timings, unsigned int address, unsigned int* value) {
+    unsigned int i;
+
+    for (i = 0; i < TIMING_REGS_COUNT; i++) {
+        if (timings[i].address == address) {
+            *value = timings[i].value;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 void print_memory_timings() {
     const char* bool_str[2] = { "Disabled", "Enabled" };
-    unsigned int value1, value2, offset;
+    smu_smn_op_t timings[TIMING_REGS_COUNT];
+    unsigned int value1, value2, offset, i;
+
+    if (smu_read_smn_addr(&obj, 0x50200, &value1) != SMU_Return_OK)
+        goto _READ_ERROR;
 
-    READ_SMN_V1(0x50200);
     offset = value1 == 0x300 ? 0x100000 : 0;
 
+    // Read all registers of the channel at once.
+    for (i = 0; i < TIMING_REGS_COUNT; i++) {
+        timings[i].address = timing_regs[i] + offset;
+        timings[i].write = 0;
+    }
+
+    if (smu_rw_smn_batch(&obj, timings, TIMING_REGS_COUNT) != SMU_Return_OK)
+        goto _READ_ERROR;
+
     READ_SMN_V1(0x50050); READ_SMN_V2(0x50058);
     fprintf(stdout, "BankGroupSwap: %s\n",
         bool_str[!(value1 == value2 && value1 == 0x87654321)]);
@@ -0,0 +1,203 @@
+/**
+ * Ryzen SMU Mailbox Polling Test
+ * Copyright (C) 2020 Leonardo Gates <leogatesx9r@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+// Runs the polling of the driver against an emulated mailbox on a simulated clock, checking that
+//  commands answered in time complete, that unanswered ones time out no earlier than configured
+//  and not much later, and that the deprecated smu_timeout_attempts parameter is converted as
+//  documented.
+
+#include <stdio.h>
+#include <limits.h>
+
+#include <smu_poll.h>
+
+#define NSEC_PER_USEC                   1000ULL
+
+// Cost of a single poll of the response register, i.e. two PCI config cycles.
+#define POLL_COST_NS                    1500ULL
+
+// Sleeps last up to twice as long as requested, see usleep_range(), plus this much scheduler delay.
+#define OVERSLEEP_US                    50
+
+/**
+ * Mailbox which answers [answer_us] after the command was written, or never if it's 0.
+ */
+struct mailbox {
+    u64                        now;
+    u64                        answer_at;
+    u32                        polls;
+    u32                        sleeps;
+    u32                        max_sleep_us;
+};
+
+// Mirror of smu_wait_for_response() in smu.c, with the register read and sleep emulated.
+static int mailbox_wait(struct mailbox* mb, u64 deadline) {
+    struct smu_poll poll;
+    u32 sleep_us;
+
+    smu_poll_init(&poll, mb->now, deadline);
+
+    for (;;) {
+        mb->polls++;
+        mb->now += POLL_COST_NS;
+
+        if (mb->answer_at && mb->now >= mb->answer_at)
+            return 0;
+
+        switch (smu_poll_next(&poll, mb->now, &sleep_us)) {
+            case SMU_POLL_TIMEOUT:
+                return -1;
+            case SMU_POLL_SPIN:
+                break;
+            case SMU_POLL_SLEEP:
+                if (sleep_us < SMU_POLL_SLEEP_MIN_US || sleep_us > SMU_POLL_SLEEP_MAX_US) {
+                    printf("  sleep of %u us out of bounds\n", sleep_us);
+                    return -2;
+                }
+
+                if (sleep_us > mb->max_sleep_us)
+                    mb->max_sleep_us = sleep_us;
+
+                mb->sleeps++;
+                mb->now += (2ULL * sleep_us + OVERSLEEP_US) * NSEC_PER_USEC;
+                break;
+        }
+    }
+}
+
+static int failures;
+
+static void check(int cond, const char* what, u32 timeout_us, u32 answer_us) {
+    if (cond)
+        return;
+
+    printf("FAIL: %s (timeout %u us, answered after %u us)\n", what, timeout_us, answer_us);
+    failures++;
+}
+
+/**
+ * Executes a command on the emulated mailbox, which is idle, answering after [answer_us] or never
+ *  if it's 0. Returns the result of the wait for the command, [elapsed_us] is set to its duration.
+ */
+static int run_command(u32 timeout_us, u32 answer_us, u64* elapsed_us, struct mailbox* mb) {
+    u64 start = 1000000000ULL, deadline;
+    int ret;
+
+    *mb = (struct mailbox){ .now = start };
+    *elapsed_us = 0;
+
+    deadline = smu_poll_deadline(mb->now, timeout_us);
+
+    // Step 1, the previous command was answered long ago.
+    mb->answer_at = 1;
+    ret = mailbox_wait(mb, deadline);
+    if (ret)
+        return ret;
+
+    // Step 5, the register was cleared and the command written.
+    mb->answer_at = answer_us ? mb->now + answer_us * NSEC_PER_USEC : 0;
+    ret = mailbox_wait(mb, deadline);
+
+    *elapsed_us = (mb->now - start) / NSEC_PER_USEC;
+
+    return ret;
+}
+
+static void test_timeouts(void) {
+    const u32 timeouts[] = { 0, SMU_TIMEOUT_MIN_US, 2000, SMU_TIMEOUT_DEFAULT_US, SMU_TIMEOUT_MAX_US,
+        UINT_MAX };
+    const u32 answers[] = { 1, 5, 19, 21, 100, 499, 1000, 4999, 19999, 999999 };
+    u32 i, j, timeout_us, bound_us;
+    struct mailbox mb;
+    u64 elapsed_us;
+    int ret;
+
+    for (i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); i++) {
+        timeout_us = timeouts[i];
+        bound_us = timeout_us < SMU_TIMEOUT_MIN_US ? SMU_TIMEOUT_MIN_US :
+            timeout_us > SMU_TIMEOUT_MAX_US ? SMU_TIMEOUT_MAX_US : timeout_us;
+
+        // Never answered: times out no earlier than configured, and at most a sleep later.
+        ret = run_command(timeout_us, 0, &elapsed_us, &mb);
+        check(ret == -1, "unanswered command didn't time out", timeout_us, 0);
+        check(elapsed_us >= bound_us, "timed out early", timeout_us, 0);
+        check(elapsed_us <= bound_us + 2 * SMU_POLL_SLEEP_MAX_US + OVERSLEEP_US + 1,
+            "timed out late", timeout_us, 0);
+        check(mb.max_sleep_us <= SMU_POLL_SLEEP_MAX_US, "slept too long", timeout_us, 0);
+
+        printf("timeout %10u us: unanswered after %7llu us, %5u polls, %4u sleeps\n",
+            timeout_us, elapsed_us, mb.polls, mb.sleeps);
+
+        // Answered in time: always completes, even when the last sleep overshoots the deadline.
+        for (j = 0; j < sizeof(answers) / sizeof(answers[0]); j++) {
+            if (answers[j] >= bound_us)
+                continue;
+
+            ret = run_command(timeout_us, answers[j], &elapsed_us, &mb);
+            check(ret == 0, "answered command timed out", timeout_us, answers[j]);
+
+            // Fast answers are caught while spinning, without sleeping at all.
+            if (answers[j] < SMU_POLL_SPIN_US)
+                check(!mb.sleeps, "slept on a fast answer", timeout_us, answers[j]);
+        }
+    }
+}
+
+static void test_attempts(void) {
+    const struct {
+        u32 attempts;
+        u32 timeout_us;
+    } cases[] = {
+        { 0,                            0 },
+        { 1,                            2 },
+        { 4096,                         SMU_TIMEOUT_DEFAULT_US / 2 },
+        { SMU_TIMEOUT_ATTEMPTS_DEFAULT, SMU_TIMEOUT_DEFAULT_US },
+        { 409600,                       SMU_TIMEOUT_MAX_US },
+        { UINT_MAX,                     UINT_MAX },
+    };
+    u32 i, us;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        us = smu_timeout_attempts_to_us(cases[i].attempts);
+
+        printf("smu_timeout_attempts %10u -> %10u us\n", cases[i].attempts, us);
+        check(us == cases[i].timeout_us, "attempts converted incorrectly", us, 0);
+    }
+
+    check(smu_timeout_us_to_attempts(SMU_TIMEOUT_DEFAULT_US) == SMU_TIMEOUT_ATTEMPTS_DEFAULT,
+        "default timeout not reported as default attempts", SMU_TIMEOUT_DEFAULT_US, 0);
+
+    // Reading the parameter back must convert to the same timeout.
+    for (us = 0; us <= SMU_TIMEOUT_MAX_US; us += 125)
+        if (smu_timeout_attempts_to_us(smu_timeout_us_to_attempts(us)) > us)
+            check(0, "round trip increased the timeout", us, 0);
+}
+
+int main(void) {
+    test_attempts();
+    test_timeouts();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+
+    return 0;
+}